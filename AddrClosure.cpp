@@ -0,0 +1,89 @@
+#include "llvm/Support/raw_ostream.h"
+#include "AddrClosure.h"
+#include <queue>
+
+const DenseMap<PHINode*, vector<int>> &closureCache::extractGEP(GetElementPtrInst *gep) {
+	auto found = gepFacts.find(gep);
+	if(found != gepFacts.end()) {
+		return found->second;
+	}
+	DenseMap<PHINode*, vector<int>> &facts = gepFacts[gep];
+	Type *tp = gep->getSourceElementType();
+	if(!tp->isArrayTy()) {
+		errs() << "Not array type, exiting\n";
+		exit(-1);
+	}
+	vector<int> dimsV;
+	ArrayType *atp = cast<ArrayType>(tp);
+	while(atp->getElementType()->isArrayTy()) {
+		atp = cast<ArrayType>(atp->getElementType());
+		dimsV.push_back(atp->getNumElements());
+	}
+	if(dimsV.empty()) {
+		dimsV.push_back(1);
+	}
+
+	//the first induction variable the outermost index is computed from
+	DenseSet<Value*> visited;
+	queue<Instruction*> valQ;
+	if(Instruction *idx = dyn_cast<Instruction>(gep->getOperand(2))) {
+		valQ.push(idx);
+		visited.insert(idx);
+	}
+	while(!valQ.empty()) {
+		Instruction *inst = valQ.front();
+		valQ.pop();
+		if(PHINode *phi = dyn_cast<PHINode>(inst)) {
+			facts[phi] = dimsV;
+			break;
+		}
+		for(Use &U : inst->operands()) {
+			Instruction *op = dyn_cast<Instruction>(U.get());
+			if(op && visited.insert(op).second) {
+				valQ.push(op);
+			}
+		}
+	}
+	return facts;
+}
+
+const struct addrClosure &closureCache::get(Value *ptr) {
+	unique_ptr<struct addrClosure> &slot = closures[ptr];
+	if(slot) {
+		return *slot;
+	}
+	slot.reset(new addrClosure());
+	struct addrClosure &cl = *slot;
+	cl.alloc = nullptr;
+	cl.phis = 0;
+	if(Instruction *inst = dyn_cast<Instruction>(ptr)) {
+		cl.values.push_back(inst);
+		cl.members.insert(inst);
+	}
+	//values doubles as the queue of the walk
+	for(unsigned next = 0; next < cl.values.size(); next++) {
+		Instruction *inst = cl.values[next];
+		if(GetElementPtrInst *gep = dyn_cast<GetElementPtrInst>(inst)) {
+			const DenseMap<PHINode*, vector<int>> &facts = extractGEP(gep);
+			cl.hidFact.insert(facts.begin(), facts.end());
+		}
+		if(AllocaInst *alloca = dyn_cast<AllocaInst>(inst)) {
+			cl.alloc = alloca;
+		}
+		else if(isa<PHINode>(inst)) {
+			cl.phis++;
+		}
+		for(Use &U : inst->operands()) {
+			Instruction *op = dyn_cast<Instruction>(U.get());
+			if(op && cl.members.insert(op).second) {
+				cl.values.push_back(op);
+			}
+		}
+	}
+	return cl;
+}
+
+void closureCache::clear() {
+	closures.clear();
+	gepFacts.clear();
+}
@@ -0,0 +1,40 @@
+#ifndef _ADDRCLOSURE_H_
+#define _ADDRCLOSURE_H_
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/IR/Instructions.h"
+#include <memory>
+#include <vector>
+using namespace llvm;
+using namespace std;
+
+// Instructions the address of a load or store is computed from, in the
+// breadth first order they are reached from its pointer operand. Values
+// that are not instructions end the walk; names play no part in it or in
+// the facts kept for the induction variables.
+struct addrClosure {
+	vector<Instruction*> values;
+	DenseSet<Value*> members;
+	//last alloca reached, the array accessed
+	AllocaInst *alloc;
+	unsigned phis;
+	//dimensions below the first index of every array GEP, by the induction variable indexing it
+	DenseMap<PHINode*, vector<int>> hidFact;
+};
+
+// Closures of the address operands of one function. Loads and stores of
+// the same address and the GEPs shared between closures are walked once;
+// clear() before the next function.
+class closureCache {
+	DenseMap<Value*, unique_ptr<struct addrClosure>> closures;
+	DenseMap<Value*, DenseMap<PHINode*, vector<int>>> gepFacts;
+
+	const DenseMap<PHINode*, vector<int>> &extractGEP(GetElementPtrInst *gep);
+
+	public:
+	const struct addrClosure &get(Value *ptr);
+	void clear();
+};
+
+#endif
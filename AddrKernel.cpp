@@ -0,0 +1,320 @@
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "AddrKernel.h"
+#include "DervInd.h"
+#include <climits>
+//the kernels keep addresses in 64 bit lanes, which is what long is here
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define ADDR_KERNEL_X86
+#endif
+
+static cl::opt<bool> StreamSIMD("stream-simd", cl::init(true), cl::desc("Use AVX2/AVX-512 kernels for stream address generation and stride scans"));
+
+template<int Shape>
+static void termScalar(const struct compiledChains &cc, const struct chainEval &e, const int *x, long *out, long n) {
+	for(long k = 0; k < n; k++) {
+		out[k] = out[k] + evalTerm<Shape>(cc, e, x[k]);
+	}
+}
+
+static void addrKernelScalar(const struct compiledChains &cc, const int *ind, long stride, long *out, long n) {
+	for(long k = 0; k < n; k++) {
+		out[k] = cc.base;
+	}
+	for(unsigned lvl = 0; lvl < cc.slope.size(); lvl++) {
+		long s = cc.slope[lvl];
+		if(s == 0) {
+			continue;
+		}
+		const int *x = ind + lvl * stride;
+		for(long k = 0; k < n; k++) {
+			out[k] = out[k] + s * x[k];
+		}
+	}
+	for(const struct chainEval &e : cc.terms) {
+		const int *x = ind + e.level * stride;
+		switch(e.shape) {
+			case AffineMod : termScalar<AffineMod>(cc, e, x, out, n); break;
+			case AffineShift : termScalar<AffineShift>(cc, e, x, out, n); break;
+			case AffineAnd : termScalar<AffineAnd>(cc, e, x, out, n); break;
+			case ShiftMask : termScalar<ShiftMask>(cc, e, x, out, n); break;
+			default : termScalar<Generic>(cc, e, x, out, n); break;
+		}
+	}
+}
+
+static long runKernelScalar(const long *addrs, long n, long unit, long *units) {
+	long cnt = 0;
+	for(long i = 1; i < n; i++) {
+		long diff = addrs[i] - addrs[i - 1];
+		if(diff == unit) {
+			cnt++;
+		}
+		else if(diff != 0) {
+			*units += cnt;
+			return i;
+		}
+	}
+	*units += cnt;
+	return n;
+}
+
+#ifdef ADDR_KERNEL_X86
+// The SIMD kernels scale the induction values with the signed 32 bit
+// products of mul_epi32, so every slope and c must fit in an int
+static bool narrowChains(const struct compiledChains &cc) {
+	for(long s : cc.slope) {
+		if(s < INT_MIN || s > INT_MAX) {
+			return false;
+		}
+	}
+	for(const struct chainEval &e : cc.terms) {
+		if(e.c < INT_MIN || e.c > INT_MAX) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Truncating remainder through double division, which is exact for 32 bit
+// operands and matches the C % used by the scalar path.
+__attribute__((target("avx2")))
+static inline __m256i modAVX2(__m256i val, __m256d dm, __m256i m) {
+	__m128i qlo = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(val)), dm));
+	__m128i qhi = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(val, 1)), dm));
+	__m256i q = _mm256_inserti128_si256(_mm256_castsi128_si256(qlo), qhi, 1);
+	return _mm256_sub_epi32(val, _mm256_mullo_epi32(q, m));
+}
+
+// c * v + d of four int lanes, added to four addresses
+__attribute__((target("avx2")))
+static inline void scaleAddAVX2(__m128i v, __m256i c, __m256i d, long *out) {
+	__m256i w = _mm256_add_epi64(_mm256_mul_epi32(_mm256_cvtepi32_epi64(v), c), d);
+	_mm256_storeu_si256((__m256i *)out, _mm256_add_epi64(_mm256_loadu_si256((const __m256i *)out), w));
+}
+
+template<int Shape>
+__attribute__((target("avx2")))
+static void termAVX2(const struct compiledChains &cc, const struct chainEval &e, const int *x, long *out, long n) {
+	__m256i a = _mm256_set1_epi32(e.a), b = _mm256_set1_epi32(e.b);
+	__m256i c = _mm256_set1_epi64x(e.c), d = _mm256_set1_epi64x(e.d);
+	__m256i k1 = _mm256_set1_epi32(e.k1), k2 = _mm256_set1_epi32(e.k2);
+	__m256d dk1 = _mm256_set1_pd((double)e.k1);
+	__m128i sh = _mm_cvtsi32_si128(e.k1);
+	long k = 0;
+	for(; k + 8 <= n; k += 8) {
+		__m256i v = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_loadu_si256((const __m256i *)(x + k)), a), b);
+		if(Shape == AffineMod) {
+			v = modAVX2(v, dk1, k1);
+		}
+		else if(Shape == AffineShift) {
+			v = _mm256_sra_epi32(v, sh);
+		}
+		else if(Shape == AffineAnd) {
+			v = _mm256_and_si256(v, k1);
+		}
+		else if(Shape == ShiftMask) {
+			v = _mm256_and_si256(_mm256_sra_epi32(v, sh), k2);
+		}
+		scaleAddAVX2(_mm256_castsi256_si128(v), c, d, out + k);
+		scaleAddAVX2(_mm256_extracti128_si256(v, 1), c, d, out + k + 4);
+	}
+	termScalar<Shape>(cc, e, x + k, out + k, n - k);
+}
+
+__attribute__((target("avx2")))
+static void addrKernelAVX2(const struct compiledChains &cc, const int *ind, long stride, long *out, long n) {
+	if(!narrowChains(cc)) {
+		addrKernelScalar(cc, ind, stride, out, n);
+		return;
+	}
+	__m256i base = _mm256_set1_epi64x(cc.base);
+	long k = 0;
+	for(; k + 4 <= n; k += 4) {
+		__m256i acc = base;
+		for(unsigned lvl = 0; lvl < cc.slope.size(); lvl++) {
+			__m256i x = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *)(ind + lvl * stride + k)));
+			acc = _mm256_add_epi64(acc, _mm256_mul_epi32(x, _mm256_set1_epi64x(cc.slope[lvl])));
+		}
+		_mm256_storeu_si256((__m256i *)(out + k), acc);
+	}
+	for(; k < n; k++) {
+		out[k] = cc.base;
+		for(unsigned lvl = 0; lvl < cc.slope.size(); lvl++) {
+			out[k] = out[k] + cc.slope[lvl] * ind[lvl * stride + k];
+		}
+	}
+	for(const struct chainEval &e : cc.terms) {
+		const int *x = ind + e.level * stride;
+		switch(e.shape) {
+			case AffineMod : termAVX2<AffineMod>(cc, e, x, out, n); break;
+			case AffineShift : termAVX2<AffineShift>(cc, e, x, out, n); break;
+			case AffineAnd : termAVX2<AffineAnd>(cc, e, x, out, n); break;
+			case ShiftMask : termAVX2<ShiftMask>(cc, e, x, out, n); break;
+			default : termScalar<Generic>(cc, e, x, out, n); break;
+		}
+	}
+}
+
+// Four differences per step; a step holding a jump is left to the scalar
+// loop, which stops inside it
+__attribute__((target("avx2")))
+static long runKernelAVX2(const long *addrs, long n, long unit, long *units) {
+	__m256i u = _mm256_set1_epi64x(unit), z = _mm256_setzero_si256();
+	long cnt = 0;
+	long i = 1;
+	for(; i + 4 <= n; i += 4) {
+		__m256i diff = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *)(addrs + i)), _mm256_loadu_si256((const __m256i *)(addrs + i - 1)));
+		int isUnit = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(diff, u)));
+		int isZero = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(diff, z)));
+		if((isUnit | isZero) != 0xf) {
+			break;
+		}
+		cnt += __builtin_popcount(isUnit);
+	}
+	*units += cnt;
+	long j = runKernelScalar(addrs + i - 1, n - i + 1, unit, units);
+	return i - 1 + j;
+}
+
+__attribute__((target("avx512f")))
+static inline __m512i modAVX512(__m512i val, __m512d dm, __m512i m) {
+	__m256i qlo = _mm512_cvttpd_epi32(_mm512_div_pd(_mm512_cvtepi32_pd(_mm512_castsi512_si256(val)), dm));
+	__m256i qhi = _mm512_cvttpd_epi32(_mm512_div_pd(_mm512_cvtepi32_pd(_mm512_extracti64x4_epi64(val, 1)), dm));
+	__m512i q = _mm512_inserti64x4(_mm512_castsi256_si512(qlo), qhi, 1);
+	return _mm512_sub_epi32(val, _mm512_mullo_epi32(q, m));
+}
+
+// c * v + d of eight int lanes, added to eight addresses
+__attribute__((target("avx512f")))
+static inline void scaleAddAVX512(__m256i v, __m512i c, __m512i d, long *out) {
+	__m512i w = _mm512_add_epi64(_mm512_mul_epi32(_mm512_cvtepi32_epi64(v), c), d);
+	_mm512_storeu_si512((void *)out, _mm512_add_epi64(_mm512_loadu_si512((const void *)out), w));
+}
+
+template<int Shape>
+__attribute__((target("avx512f")))
+static void termAVX512(const struct compiledChains &cc, const struct chainEval &e, const int *x, long *out, long n) {
+	__m512i a = _mm512_set1_epi32(e.a), b = _mm512_set1_epi32(e.b);
+	__m512i c = _mm512_set1_epi64(e.c), d = _mm512_set1_epi64(e.d);
+	__m512i k1 = _mm512_set1_epi32(e.k1), k2 = _mm512_set1_epi32(e.k2);
+	__m512d dk1 = _mm512_set1_pd((double)e.k1);
+	__m128i sh = _mm_cvtsi32_si128(e.k1);
+	long k = 0;
+	for(; k + 16 <= n; k += 16) {
+		__m512i v = _mm512_add_epi32(_mm512_mullo_epi32(_mm512_loadu_si512((const void *)(x + k)), a), b);
+		if(Shape == AffineMod) {
+			v = modAVX512(v, dk1, k1);
+		}
+		else if(Shape == AffineShift) {
+			v = _mm512_sra_epi32(v, sh);
+		}
+		else if(Shape == AffineAnd) {
+			v = _mm512_and_si512(v, k1);
+		}
+		else if(Shape == ShiftMask) {
+			v = _mm512_and_si512(_mm512_sra_epi32(v, sh), k2);
+		}
+		scaleAddAVX512(_mm512_castsi512_si256(v), c, d, out + k);
+		scaleAddAVX512(_mm512_extracti64x4_epi64(v, 1), c, d, out + k + 8);
+	}
+	termScalar<Shape>(cc, e, x + k, out + k, n - k);
+}
+
+__attribute__((target("avx512f")))
+static void addrKernelAVX512(const struct compiledChains &cc, const int *ind, long stride, long *out, long n) {
+	if(!narrowChains(cc)) {
+		addrKernelScalar(cc, ind, stride, out, n);
+		return;
+	}
+	__m512i base = _mm512_set1_epi64(cc.base);
+	long k = 0;
+	for(; k + 8 <= n; k += 8) {
+		__m512i acc = base;
+		for(unsigned lvl = 0; lvl < cc.slope.size(); lvl++) {
+			__m512i x = _mm512_cvtepi32_epi64(_mm256_loadu_si256((const __m256i *)(ind + lvl * stride + k)));
+			acc = _mm512_add_epi64(acc, _mm512_mul_epi32(x, _mm512_set1_epi64(cc.slope[lvl])));
+		}
+		_mm512_storeu_si512((void *)(out + k), acc);
+	}
+	for(; k < n; k++) {
+		out[k] = cc.base;
+		for(unsigned lvl = 0; lvl < cc.slope.size(); lvl++) {
+			out[k] = out[k] + cc.slope[lvl] * ind[lvl * stride + k];
+		}
+	}
+	for(const struct chainEval &e : cc.terms) {
+		const int *x = ind + e.level * stride;
+		switch(e.shape) {
+			case AffineMod : termAVX512<AffineMod>(cc, e, x, out, n); break;
+			case AffineShift : termAVX512<AffineShift>(cc, e, x, out, n); break;
+			case AffineAnd : termAVX512<AffineAnd>(cc, e, x, out, n); break;
+			case ShiftMask : termAVX512<ShiftMask>(cc, e, x, out, n); break;
+			default : termScalar<Generic>(cc, e, x, out, n); break;
+		}
+	}
+}
+
+__attribute__((target("avx512f")))
+static long runKernelAVX512(const long *addrs, long n, long unit, long *units) {
+	__m512i u = _mm512_set1_epi64(unit), z = _mm512_setzero_si512();
+	long cnt = 0;
+	long i = 1;
+	for(; i + 8 <= n; i += 8) {
+		__m512i diff = _mm512_sub_epi64(_mm512_loadu_si512((const void *)(addrs + i)), _mm512_loadu_si512((const void *)(addrs + i - 1)));
+		__mmask8 isUnit = _mm512_cmpeq_epi64_mask(diff, u);
+		__mmask8 isZero = _mm512_cmpeq_epi64_mask(diff, z);
+		if((__mmask8)(isUnit | isZero) != 0xff) {
+			break;
+		}
+		cnt += __builtin_popcount(isUnit);
+	}
+	*units += cnt;
+	long j = runKernelScalar(addrs + i - 1, n - i + 1, unit, units);
+	return i - 1 + j;
+}
+#endif
+
+addrKernelFn getAddrKernel() {
+#ifdef ADDR_KERNEL_X86
+	if(StreamSIMD) {
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx512f")) {
+			return addrKernelAVX512;
+		}
+		if(__builtin_cpu_supports("avx2")) {
+			return addrKernelAVX2;
+		}
+	}
+#endif
+	return addrKernelScalar;
+}
+
+const char *getAddrKernelName() {
+	addrKernelFn kernel = getAddrKernel();
+#ifdef ADDR_KERNEL_X86
+	if(kernel == addrKernelAVX512) {
+		return "avx512";
+	}
+	if(kernel == addrKernelAVX2) {
+		return "avx2";
+	}
+#endif
+	return "scalar";
+}
+
+runKernelFn getRunKernel() {
+#ifdef ADDR_KERNEL_X86
+	if(StreamSIMD) {
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx512f")) {
+			return runKernelAVX512;
+		}
+		if(__builtin_cpu_supports("avx2")) {
+			return runKernelAVX2;
+		}
+	}
+#endif
+	return runKernelScalar;
+}
@@ -0,0 +1,26 @@
+#ifndef _ADDRKERNEL_H_
+#define _ADDRKERNEL_H_
+
+#include "ChainEval.h"
+
+// Computes out[k] for k < n, where the induction value of level l for lane k
+// is ind[l * stride + k]. The affine part of all levels is applied first,
+// then every remaining term runs through the kernel specialized for its shape.
+// Induction values are int and addresses long.
+typedef void (*addrKernelFn)(const struct compiledChains &cc, const int *ind, long stride, long *out, long n);
+
+// Returns the widest kernel the host supports: AVX-512 (8 addresses per
+// step), AVX2 (4) or the scalar fallback. -stream-simd=false forces the
+// fallback, as do multipliers that need more than 32 bits.
+addrKernelFn getAddrKernel();
+const char *getAddrKernelName();
+
+// Scans the differences addrs[i] - addrs[i - 1] for i in [1, n), adding the
+// number equal to unit to *units and skipping zeros, and stops at the first
+// other difference: returns its index, or n when there is none. Stride
+// analysis spends its time here, between two jumps.
+typedef long (*runKernelFn)(const long *addrs, long n, long unit, long *units);
+
+runKernelFn getRunKernel();
+
+#endif
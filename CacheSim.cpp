@@ -0,0 +1,333 @@
+#include "llvm/Support/raw_ostream.h"
+#include "CacheSim.h"
+#include "StreamDeps.h"
+#include "StreamLog.h"
+#include <algorithm>
+#include <climits>
+#include <map>
+
+cacheSim::cacheSim(const struct cacheConfig &cfg) : config(cfg), lineShift(0), clock(0), seed(0x9E3779B97F4A7C15UL), lastLine(LONG_MIN), head(-1), tail(-1), used(0), seenLo(0) {
+	for(unsigned bytes = config.line; bytes > 1; bytes >>= 1) {
+		lineShift++;
+	}
+	long lines = config.size / config.line;
+	long sets = lines / config.ways;
+	setMask = sets - 1;
+	tags.assign(lines, LONG_MIN);
+	stamps.assign(lines, 0);
+	plru.assign(sets, 0);
+	nodeLine.assign(lines, 0);
+	prevNode.assign(lines, -1);
+	nextNode.assign(lines, -1);
+	//at most a quarter full, so probes stay short
+	long slots = 4;
+	while(slots < 4 * lines) {
+		slots *= 2;
+	}
+	slotLine.assign(slots, LONG_MIN);
+	slotNode.assign(slots, 0);
+	slotMask = slots - 1;
+}
+
+void cacheSim::expectLines(long lo, long hi) {
+	seenLo = lo;
+	seenBits.assign(hi > lo ? (hi - lo + 63) / 64 : 0, 0);
+}
+
+bool cacheSim::firstTouch(long line) {
+	unsigned long off = line - seenLo;
+	if(off < seenBits.size() * 64) {
+		unsigned long bit = 1UL << (off & 63);
+		bool first = !(seenBits[off >> 6] & bit);
+		seenBits[off >> 6] |= bit;
+		return first;
+	}
+	long &cnt = seenFar.at(line);
+	return cnt++ == 0;
+}
+
+// slot holding line in the shadow's table, or the empty slot it would go to
+long cacheSim::slotOf(long line) const {
+	long i = (unsigned long)line * 0x9E3779B97F4A7C15UL >> 32 & slotMask;
+	while(slotLine[i] != LONG_MIN && slotLine[i] != line) {
+		i = (i + 1) & slotMask;
+	}
+	return i;
+}
+
+// removes line by shifting back the entries probed past it
+void cacheSim::eraseSlot(long line) {
+	long i = slotOf(line);
+	for(long j = (i + 1) & slotMask; slotLine[j] != LONG_MIN; j = (j + 1) & slotMask) {
+		long home = (unsigned long)slotLine[j] * 0x9E3779B97F4A7C15UL >> 32 & slotMask;
+		if(((j - home) & slotMask) >= ((j - i) & slotMask)) {
+			slotLine[i] = slotLine[j];
+			slotNode[i] = slotNode[j];
+			i = j;
+		}
+	}
+	slotLine[i] = LONG_MIN;
+}
+
+void cacheSim::touch(long set, unsigned way) {
+	if(config.repl == ReplLRU) {
+		stamps[set * config.ways + way] = ++clock;
+	}
+	else if(config.repl == ReplPLRU) {
+		//every node on the way's path points to the half it did not take
+		unsigned long &bits = plru[set];
+		unsigned node = 1;
+		for(unsigned half = config.ways >> 1; half > 0; half >>= 1) {
+			unsigned taken = (way & half) ? 1 : 0;
+			if(taken) {
+				bits &= ~(1UL << (node - 1));
+			}
+			else {
+				bits |= 1UL << (node - 1);
+			}
+			node = node * 2 + taken;
+		}
+	}
+}
+
+unsigned cacheSim::victim(long set) {
+	long first = set * config.ways;
+	if(config.repl == ReplLRU) {
+		//empty ways keep stamp 0, so they go first
+		unsigned way = 0;
+		for(unsigned w = 1; w < config.ways; w++) {
+			if(stamps[first + w] < stamps[first + way]) {
+				way = w;
+			}
+		}
+		return way;
+	}
+	for(unsigned w = 0; w < config.ways; w++) {
+		if(tags[first + w] == LONG_MIN) {
+			return w;
+		}
+	}
+	if(config.repl == ReplPLRU) {
+		unsigned node = 1;
+		while(node < config.ways) {
+			node = node * 2 + ((plru[set] >> (node - 1)) & 1);
+		}
+		return node - config.ways;
+	}
+	seed ^= seed << 13;
+	seed ^= seed >> 7;
+	seed ^= seed << 17;
+	return seed % config.ways;
+}
+
+void cacheSim::unlink(long node) {
+	if(prevNode[node] >= 0) {
+		nextNode[prevNode[node]] = nextNode[node];
+	}
+	else {
+		head = nextNode[node];
+	}
+	if(nextNode[node] >= 0) {
+		prevNode[nextNode[node]] = prevNode[node];
+	}
+	else {
+		tail = prevNode[node];
+	}
+}
+
+void cacheSim::pushFront(long node) {
+	prevNode[node] = -1;
+	nextNode[node] = head;
+	if(head >= 0) {
+		prevNode[head] = node;
+	}
+	head = node;
+	if(tail < 0) {
+		tail = node;
+	}
+}
+
+// 1 when the shadow holds the line, -1 on the first access to it, else 0
+int cacheSim::shadowAccess(long line, bool install) {
+	long slot = slotOf(line);
+	if(slotLine[slot] == line) {
+		unlink(slotNode[slot]);
+		pushFront(slotNode[slot]);
+		return 1;
+	}
+	int state = firstTouch(line) ? -1 : 0;
+	if(!install) {
+		return state;
+	}
+	long node;
+	if(used < (long)nodeLine.size()) {
+		node = used++;
+	}
+	else {
+		node = tail;
+		unlink(node);
+		eraseSlot(nodeLine[node]);
+		slot = slotOf(line);
+	}
+	nodeLine[node] = line;
+	pushFront(node);
+	slotLine[slot] = line;
+	slotNode[slot] = node;
+	return state;
+}
+
+void cacheSim::access(long line, bool store, struct cacheCounts &counts) {
+	//the most recent line of both caches stays where it is
+	if(line == lastLine) {
+		counts.hits++;
+		return;
+	}
+	bool install = !store || config.writeAllocate;
+	int shadow = shadowAccess(line, install);
+	long set = line & setMask;
+	long *setTags = &tags[set * config.ways];
+	for(unsigned w = 0; w < config.ways; w++) {
+		if(setTags[w] == line) {
+			touch(set, w);
+			counts.hits++;
+			lastLine = line;
+			return;
+		}
+	}
+	counts.misses++;
+	if(shadow < 0) {
+		counts.cold++;
+	}
+	else if(shadow > 0) {
+		counts.conflicts++;
+	}
+	if(install) {
+		unsigned w = victim(set);
+		setTags[w] = line;
+		touch(set, w);
+		lastLine = line;
+	}
+}
+
+void placeArrays(vector<struct simAccess> &accesses, long align) {
+	std::map<std::string, pair<long, long>> extent;
+	vector<std::string> order;
+	for(struct simAccess &acc : accesses) {
+		if(extent.find(acc.array) == extent.end()) {
+			extent[acc.array] = make_pair(0L, 0L);
+			order.push_back(acc.array);
+		}
+		if(acc.desc.size() == 0) {
+			continue;
+		}
+		//the ends of a stream need not be its extremes, as under % or &
+		pair<long, long> &ext = extent[acc.array];
+		long lo = LONG_MAX, hi = LONG_MIN;
+		streamRange(acc.desc, lo, hi);
+		ext.first = std::min(ext.first, lo);
+		ext.second = std::max(ext.second, hi + acc.elemSize);
+	}
+
+	std::map<std::string, long> base;
+	long next = 0;
+	for(std::string &array : order) {
+		long start = next - extent[array].first;
+		start = (start + align - 1) / align * align;
+		base[array] = start;
+		next = start + extent[array].second;
+	}
+	for(struct simAccess &acc : accesses) {
+		acc.base = base[acc.array];
+	}
+}
+
+void simulateNest(const struct cacheConfig &config, vector<struct simAccess> &accesses, vector<struct cacheCounts> &counts) {
+	cacheSim cache(config);
+	struct cacheCounts zero = {0, 0, 0, 0};
+	counts.assign(accesses.size(), zero);
+	long total = 0;
+	long lo = LONG_MAX, hi = LONG_MIN;
+	unsigned shift = cache.lineBits();
+	vector<struct streamCursor> curs(accesses.size());
+	for(unsigned k = 0; k < accesses.size(); k++) {
+		const StreamDescriptor &desc = accesses[k].desc;
+		if(desc.size() > 0) {
+			curs[k] = desc.cursorAt(0);
+			long first = LONG_MAX, last = LONG_MIN;
+			streamRange(desc, first, last);
+			lo = std::min(lo, (accesses[k].base + first) >> shift);
+			hi = std::max(hi, (accesses[k].base + last + accesses[k].elemSize) >> shift);
+		}
+		total = std::max(total, desc.size());
+	}
+	if(total > 0) {
+		cache.expectLines(lo, hi + 1);
+	}
+
+	vector<long> buf(STREAM_BLOCK);
+	vector<long> lines(accesses.size() * STREAM_BLOCK);
+	for(long pos = 0; pos < total; pos += STREAM_BLOCK) {
+		long cnt = total - pos < STREAM_BLOCK ? total - pos : STREAM_BLOCK;
+		for(unsigned k = 0; k < accesses.size(); k++) {
+			long m = std::min(cnt, accesses[k].desc.size() - pos);
+			if(m <= 0) {
+				continue;
+			}
+			accesses[k].desc.fill(curs[k], buf.data(), m);
+			long *out = &lines[k * STREAM_BLOCK];
+			for(long i = 0; i < m; i++) {
+				out[i] = (accesses[k].base + buf[i]) >> shift;
+			}
+		}
+		for(long i = 0; i < cnt; i++) {
+			for(unsigned k = 0; k < accesses.size(); k++) {
+				if(pos + i < accesses[k].desc.size()) {
+					cache.access(lines[k * STREAM_BLOCK + i], accesses[k].store, counts[k]);
+				}
+			}
+		}
+	}
+}
+
+void interleaveNest(vector<struct simAccess> &accesses, long unitBytes, struct streamConsumer &consumer) {
+	long total = 0;
+	vector<struct streamCursor> curs(accesses.size());
+	for(unsigned k = 0; k < accesses.size(); k++) {
+		if(accesses[k].desc.size() > 0) {
+			curs[k] = accesses[k].desc.cursorAt(0);
+		}
+		total = std::max(total, accesses[k].desc.size());
+	}
+
+	vector<long> buf(STREAM_BLOCK);
+	vector<long> units(accesses.size() * STREAM_BLOCK);
+	vector<long> out(accesses.size() * STREAM_BLOCK);
+	for(long pos = 0; pos < total; pos += STREAM_BLOCK) {
+		long cnt = total - pos < STREAM_BLOCK ? total - pos : STREAM_BLOCK;
+		for(unsigned k = 0; k < accesses.size(); k++) {
+			long m = std::min(cnt, accesses[k].desc.size() - pos);
+			if(m <= 0) {
+				continue;
+			}
+			accesses[k].desc.fill(curs[k], buf.data(), m);
+			long *unit = &units[k * STREAM_BLOCK];
+			for(long i = 0; i < m; i++) {
+				unit[i] = (accesses[k].base + buf[i]) / unitBytes;
+			}
+		}
+		long n = 0;
+		for(long i = 0; i < cnt; i++) {
+			for(unsigned k = 0; k < accesses.size(); k++) {
+				if(pos + i < accesses[k].desc.size()) {
+					out[n++] = units[k * STREAM_BLOCK + i];
+				}
+			}
+		}
+		consumer.consume(out.data(), n);
+	}
+}
+
+void printCacheCounts(const char *name, const struct cacheCounts &counts) {
+	long capacity = counts.misses - counts.cold - counts.conflicts;
+	streamLog() << "Cache simulation of " << name << " : " << counts.hits << " hits, " << counts.misses << " misses (" << counts.cold << " cold, " << counts.conflicts << " conflict, " << capacity << " capacity)\n";
+}
@@ -0,0 +1,110 @@
+#ifndef _CACHESIM_H_
+#define _CACHESIM_H_
+
+#include "StreamDesc.h"
+#include "FlatHist.h"
+#include "StreamStats.h"
+#include <string>
+#include <vector>
+
+enum cacheRepl { ReplLRU, ReplPLRU, ReplRandom };
+
+// Geometry and policies of a simulated cache; size and line in bytes. The
+// number of sets and, for PLRU, the ways must be powers of two.
+struct cacheConfig {
+	long size;
+	unsigned line;
+	unsigned ways;
+	enum cacheRepl repl;
+	bool writeAllocate;
+};
+
+// Outcomes of one load or store. Misses are split the usual three ways:
+// cold for the first access to a line, conflict when a fully associative
+// LRU cache of the same size would have hit, capacity for the rest.
+struct cacheCounts {
+	long hits;
+	long misses;
+	long cold;
+	long conflicts;
+};
+
+// One load or store of a loop nest: its byte stream over the iteration
+// space of the nest and the array it accesses, which placeArrays gives a
+// base address.
+struct simAccess {
+	char *name;
+	std::string array;
+	int elemSize;
+	bool store;
+	StreamDescriptor desc;
+	long base;
+};
+
+// Set associative cache over flat arrays indexed by set * ways + way: the
+// tags, the last use of every way for LRU and one word of tree bits per set
+// for PLRU. A fully associative LRU cache of the same size runs alongside
+// as an intrusive list to classify the misses; its resident lines are found
+// through a small linear probing table, and lines touched before through a
+// bitmap over the expected line range.
+class cacheSim {
+	struct cacheConfig config;
+	unsigned lineShift;
+	long setMask;
+	vector<long> tags;
+	vector<unsigned long> stamps;
+	vector<unsigned long> plru;
+	unsigned long clock;
+	unsigned long seed;
+	long lastLine;
+
+	vector<long> nodeLine;
+	vector<long> prevNode;
+	vector<long> nextNode;
+	long head;
+	long tail;
+	long used;
+	vector<long> slotLine;
+	vector<long> slotNode;
+	long slotMask;
+
+	long seenLo;
+	vector<unsigned long> seenBits;
+	flatHist seenFar;
+
+	void touch(long set, unsigned way);
+	unsigned victim(long set);
+	void unlink(long node);
+	void pushFront(long node);
+	long slotOf(long line) const;
+	void eraseSlot(long line);
+	bool firstTouch(long line);
+	int shadowAccess(long line, bool install);
+
+	public:
+	cacheSim(const struct cacheConfig &config);
+	unsigned lineBits() const { return lineShift; }
+	// lines from lo up to hi are expected to be touched
+	void expectLines(long lo, long hi);
+	// one access to the line holding byte address line << lineBits()
+	void access(long line, bool store, struct cacheCounts &counts);
+};
+
+// Lays the arrays of the accesses out one after another in order of first
+// appearance, each at a multiple of align bytes and spanning the extent its
+// streams reach from the start and end of their iteration spaces.
+void placeArrays(vector<struct simAccess> &accesses, long align);
+
+// Runs the accesses of a nest through one cache in program order: position
+// p of every stream in the order of the accesses, then p + 1. The streams
+// are generated a block at a time and turned into lines before simulating.
+void simulateNest(const struct cacheConfig &config, vector<struct simAccess> &accesses, vector<struct cacheCounts> &counts);
+
+// Feeds the accesses of a nest to consumer in the order simulateNest runs
+// them, as addresses of unitBytes each from the bases placeArrays gave, so
+// a reuseState sees the accesses competing for one cache
+void interleaveNest(vector<struct simAccess> &accesses, long unitBytes, struct streamConsumer &consumer);
+
+void printCacheCounts(const char *name, const struct cacheCounts &counts);
+
+#endif
@@ -0,0 +1,111 @@
+#include "llvm/Support/raw_ostream.h"
+#include "ChainEval.h"
+#include "DervInd.h"
+
+// Folds the Mul/Add run starting at ops[j] into (a, b) and returns the index
+// of the first op that is not part of it
+static unsigned foldAffine(const vector<int> &ops, const vector<int> &facts, unsigned j, int &a, int &b) {
+	a = 1;
+	b = 0;
+	for(; j < ops.size(); j++) {
+		if(ops[j] == Oprs::Mul) {
+			a = a * facts[j];
+			b = b * facts[j];
+		}
+		else if(ops[j] == Oprs::Add) {
+			b = b + facts[j];
+		}
+		else {
+			break;
+		}
+	}
+	return j;
+}
+
+void compileLevel(struct compiledChains &cc, unsigned level, long hidFact, const vector<vector<int>> &opsVV, const vector<vector<int>> &factsVV) {
+	if(cc.slope.size() <= level) {
+		cc.slope.resize(level + 1, 0);
+	}
+	for(unsigned i = 0; i < opsVV.size(); i++) {
+		const vector<int> &ops = opsVV[i];
+		const vector<int> &facts = factsVV[i];
+		struct chainEval e;
+		e.level = level;
+		e.k1 = 0;
+		e.k2 = 0;
+		e.start = 0;
+		e.len = 0;
+
+		unsigned j = foldAffine(ops, facts, 0, e.a, e.b);
+		if(j == ops.size()) {
+			cc.slope[level] = cc.slope[level] + (long)e.a * hidFact;
+			cc.base = cc.base + (long)e.b * hidFact;
+			continue;
+		}
+
+		e.k1 = facts[j];
+		if(ops[j] == Oprs::Mod) {
+			e.shape = AffineMod;
+		}
+		else if(ops[j] == Oprs::And) {
+			e.shape = AffineAnd;
+		}
+		else if(ops[j] == Oprs::Rshift && j + 1 < ops.size() && ops[j + 1] == Oprs::And) {
+			e.shape = ShiftMask;
+			e.k2 = facts[j + 1];
+			j++;
+		}
+		else {
+			e.shape = AffineShift;
+		}
+
+		int c, d;
+		j = foldAffine(ops, facts, j + 1, c, d);
+		e.c = c;
+		e.d = d;
+		if(j != ops.size() || (e.shape == AffineMod && e.k1 == 0)) {
+			e.shape = Generic;
+			e.a = 1;
+			e.b = 0;
+			e.c = 1;
+			e.d = 0;
+			e.start = cc.ops.size();
+			e.len = ops.size();
+			cc.ops.insert(cc.ops.end(), ops.begin(), ops.end());
+			cc.facts.insert(cc.facts.end(), facts.begin(), facts.end());
+		}
+		e.c = e.c * hidFact;
+		e.d = e.d * hidFact;
+		cc.terms.push_back(e);
+	}
+}
+
+bool isAffine(const struct compiledChains &cc) {
+	return cc.terms.empty();
+}
+
+const char *shapeName(int shape) {
+	switch(shape) {
+		case Affine : return "affine";
+		case AffineMod : return "affine-mod";
+		case AffineShift : return "affine-shift";
+		case AffineAnd : return "affine-and";
+		case ShiftMask : return "shift-mask";
+		default : return "generic";
+	}
+}
+
+long evalGeneric(const struct compiledChains &cc, const struct chainEval &e, int x) {
+	int val = x;
+	for(unsigned j = e.start; j < e.start + e.len; j++) {
+		switch(cc.ops[j]) {
+			case Oprs::Mul : val = val * cc.facts[j]; break;
+			case Oprs::Add : val = val + cc.facts[j]; break;
+			case Oprs::And : val = val & cc.facts[j]; break;
+			case Oprs::Mod : val = val % cc.facts[j]; break;
+			case Oprs::Rshift : val = val >> cc.facts[j]; break;
+			default : errs() << "Error unknown operator found\n"; exit(1);
+		}
+	}
+	return e.c * val + e.d;
+}
@@ -0,0 +1,82 @@
+#ifndef _CHAINEVAL_H_
+#define _CHAINEVAL_H_
+
+#include <vector>
+using namespace std;
+
+// Shapes a derived induction op chain is folded into. Runs of Mul/Add are
+// folded into one affine map, so y = a * x + b before the nonlinear op and
+// y = c * y + d after it. The chain itself runs in int like the program;
+// c and d carry the hidFact scale, so they and the result are long.
+enum chainShape {
+	Affine,		// a * x + b
+	AffineMod,	// c * ((a * x + b) % k1) + d
+	AffineShift,	// c * ((a * x + b) >> k1) + d
+	AffineAnd,	// c * ((a * x + b) & k1) + d
+	ShiftMask,	// c * (((a * x + b) >> k1) & k2) + d
+	Generic		// anything else, interpreted from ops/facts
+};
+
+struct chainEval {
+	int shape;
+	unsigned level;
+	int a, b;
+	int k1, k2;
+	long c, d;
+	// op range of a Generic term in compiledChains::ops/facts
+	unsigned start;
+	unsigned len;
+};
+
+// Op chains of a stream compiled once per access. Affine terms, the common
+// case, are merged into one slope per level plus a constant; only the
+// remaining terms are evaluated one by one.
+struct compiledChains {
+	long base;
+	vector<long> slope;
+	vector<struct chainEval> terms;
+	vector<int> ops;
+	vector<int> facts;
+};
+
+// Folds the chains of one level, scaled by hidFact, into cc
+void compileLevel(struct compiledChains &cc, unsigned level, long hidFact, const vector<vector<int>> &opsVV, const vector<vector<int>> &factsVV);
+bool isAffine(const struct compiledChains &cc);
+const char *shapeName(int shape);
+long evalGeneric(const struct compiledChains &cc, const struct chainEval &e, int x);
+
+// Specialized evaluation of one term; Shape is a constant so the branches
+// fold away and each instantiation is a few straight-line instructions.
+template<int Shape>
+inline long evalTerm(const struct compiledChains &cc, const struct chainEval &e, int x) {
+	if(Shape == Generic) {
+		return evalGeneric(cc, e, x);
+	}
+	int v = e.a * x + e.b;
+	if(Shape == AffineMod) {
+		v = v % e.k1;
+	}
+	else if(Shape == AffineShift) {
+		v = v >> e.k1;
+	}
+	else if(Shape == AffineAnd) {
+		v = v & e.k1;
+	}
+	else if(Shape == ShiftMask) {
+		v = (v >> e.k1) & e.k2;
+	}
+	return e.c * v + e.d;
+}
+
+inline long evalTerm(const struct compiledChains &cc, const struct chainEval &e, int x) {
+	switch(e.shape) {
+		case Affine : return evalTerm<Affine>(cc, e, x);
+		case AffineMod : return evalTerm<AffineMod>(cc, e, x);
+		case AffineShift : return evalTerm<AffineShift>(cc, e, x);
+		case AffineAnd : return evalTerm<AffineAnd>(cc, e, x);
+		case ShiftMask : return evalTerm<ShiftMask>(cc, e, x);
+		default : return evalTerm<Generic>(cc, e, x);
+	}
+}
+
+#endif
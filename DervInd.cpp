@@ -21,7 +21,7 @@ using namespace llvm;
 using namespace std;
 
 
-map<Value*, tuple<Value*, vector<int>, vector<int>>> getDerived(Loop *topmost, Loop *innermost, ScalarEvolution &SE, vector<StringRef> &visits) {
+map<Value*, tuple<Value*, vector<int>, vector<int>>> getDerived(Loop *topmost, Loop *innermost, ScalarEvolution &SE, const DenseSet<Value*> &closure) {
         map<Value*, tuple<Value*, vector<int>, vector<int> >> IndVarMap;
 
         // all induction variables should have phi nodes in the header
@@ -61,8 +61,8 @@ map<Value*, tuple<Value*, vector<int>, vector<int>>> getDerived(Loop *topmost, L
             for (auto &I : *B) {
               // we only accept multiplication, addition, and subtraction
               // we only accept constant integer as one of theoperands
-	      //do analysis only if variable present in the visits/closure set passed
-	      if(find(visits.begin(), visits.end(), I.getName()) == visits.end()) {
+	      //do analysis only if variable present in the closure set passed
+	      if(!closure.count(&I)) {
 	      	continue;
 	      }
               if (auto *op = dyn_cast<BinaryOperator>(&I)) {
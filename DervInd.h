@@ -13,6 +13,7 @@
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/Analysis/LoopNestAnalysis.h"
+#include "llvm/ADT/DenseSet.h"
 using namespace llvm;
 
 #include <tuple>
@@ -21,7 +22,7 @@ using namespace llvm;
 using namespace std;
 
 
-map<Value*, tuple<Value*, vector<int>, vector<int> >> getDerived(Loop *topmost, Loop *innermost, ScalarEvolution &SE, vector<StringRef> &visits); 
+map<Value*, tuple<Value*, vector<int>, vector<int> >> getDerived(Loop *topmost, Loop *innermost, ScalarEvolution &SE, const DenseSet<Value*> &closure); 
 
 namespace Oprs {
 
@@ -0,0 +1,145 @@
+#ifndef _FLATHIST_H_
+#define _FLATHIST_H_
+
+#include <algorithm>
+#include <climits>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// Histogram of long keys in one open-addressing table with linear probing.
+// A bucket costs a hash and usually one probe instead of a tree insert and
+// node allocation. LONG_MIN marks an empty slot, so it cannot be a key.
+class flatHist {
+	vector<long> keys;
+	vector<long> counts;
+	long used;
+	unsigned shift;
+
+	unsigned slot(long key) const {
+		return (unsigned long)key * 0x9E3779B97F4A7C15UL >> shift;
+	}
+
+	void grow() {
+		vector<long> oldKeys, oldCounts;
+		oldKeys.swap(keys);
+		oldCounts.swap(counts);
+		keys.assign(oldKeys.size() * 2, LONG_MIN);
+		counts.assign(oldKeys.size() * 2, 0);
+		shift--;
+		used = 0;
+		for(unsigned i = 0; i < oldKeys.size(); i++) {
+			if(oldKeys[i] != LONG_MIN) {
+				add(oldKeys[i], oldCounts[i]);
+			}
+		}
+	}
+
+	public:
+	flatHist() : keys(64, LONG_MIN), counts(64, 0), used(0), shift(64 - 6) {}
+
+	void add(long key, long cnt = 1) {
+		unsigned mask = keys.size() - 1;
+		for(unsigned i = slot(key); ; i = (i + 1) & mask) {
+			if(keys[i] == key) {
+				counts[i] += cnt;
+				return;
+			}
+			if(keys[i] == LONG_MIN) {
+				keys[i] = key;
+				counts[i] = cnt;
+				//keep the load under a half so probes stay short
+				if(++used * 2 > (long)keys.size()) {
+					grow();
+				}
+				return;
+			}
+		}
+	}
+
+	// count of key, inserted as 0 when missing; valid until the next insert
+	long &at(long key) {
+		unsigned mask = keys.size() - 1;
+		unsigned i = slot(key);
+		for(; keys[i] != LONG_MIN; i = (i + 1) & mask) {
+			if(keys[i] == key) {
+				return counts[i];
+			}
+		}
+		if((used + 1) * 2 > (long)keys.size()) {
+			grow();
+			return at(key);
+		}
+		keys[i] = key;
+		counts[i] = 0;
+		used++;
+		return counts[i];
+	}
+
+	long get(long key) const {
+		unsigned mask = keys.size() - 1;
+		for(unsigned i = slot(key); keys[i] != LONG_MIN; i = (i + 1) & mask) {
+			if(keys[i] == key) {
+				return counts[i];
+			}
+		}
+		return 0;
+	}
+
+	long size() const { return used; }
+
+	// removes key, moving back the keys that probed past its slot
+	void erase(long key) {
+		unsigned mask = keys.size() - 1;
+		unsigned i = slot(key);
+		for(; keys[i] != key; i = (i + 1) & mask) {
+			if(keys[i] == LONG_MIN) {
+				return;
+			}
+		}
+		for(unsigned j = (i + 1) & mask; keys[j] != LONG_MIN; j = (j + 1) & mask) {
+			unsigned home = slot(keys[j]);
+			if(((j - home) & mask) >= ((j - i) & mask)) {
+				keys[i] = keys[j];
+				counts[i] = counts[j];
+				i = j;
+			}
+		}
+		keys[i] = LONG_MIN;
+		counts[i] = 0;
+		used--;
+	}
+
+	// adds every bucket of other with its count multiplied by times
+	void merge(const flatHist &other, long times = 1) {
+		for(unsigned i = 0; i < other.keys.size(); i++) {
+			if(other.keys[i] != LONG_MIN) {
+				add(other.keys[i], other.counts[i] * times);
+			}
+		}
+	}
+
+	// calls f(key, count) on every bucket in table order; f may change count
+	template<typename F>
+	void forEach(F f) {
+		for(unsigned i = 0; i < keys.size(); i++) {
+			if(keys[i] != LONG_MIN) {
+				f(keys[i], counts[i]);
+			}
+		}
+	}
+
+	// buckets in increasing key order, for printing
+	vector<pair<long, long>> sorted() const {
+		vector<pair<long, long>> out;
+		for(unsigned i = 0; i < keys.size(); i++) {
+			if(keys[i] != LONG_MIN) {
+				out.push_back(make_pair(keys[i], counts[i]));
+			}
+		}
+		std::sort(out.begin(), out.end());
+		return out;
+	}
+};
+
+#endif
@@ -0,0 +1,106 @@
+#include "NestFusion.h"
+#include "StreamDeps.h"
+#include "StreamStats.h"
+#include <algorithm>
+#include <climits>
+#include <map>
+
+void crossNestReuse(vector<vector<struct simAccess>> &nests, unsigned lineBytes, long align, long capacityLines, vector<struct nestReuse> &pairs) {
+	pairs.clear();
+	unsigned shift = 0;
+	for(unsigned bytes = lineBytes; bytes > 1; bytes >>= 1) {
+		shift++;
+	}
+
+	//one layout for the whole function, so arrays keep their lines across nests
+	vector<struct simAccess> all;
+	for(vector<struct simAccess> &nest : nests) {
+		all.insert(all.end(), nest.begin(), nest.end());
+	}
+	placeArrays(all, align);
+	long lo = LONG_MAX, hi = LONG_MIN, total = 0;
+	unsigned k = 0;
+	for(vector<struct simAccess> &nest : nests) {
+		for(struct simAccess &acc : nest) {
+			acc.base = all[k++].base;
+			if(acc.desc.size() > 0) {
+				long first = LONG_MAX, last = LONG_MIN;
+				streamRange(acc.desc, first, last);
+				lo = std::min(lo, (acc.base + first) >> shift);
+				hi = std::max(hi, (acc.base + last) >> shift);
+				total += acc.desc.size();
+			}
+		}
+	}
+	if(total == 0) {
+		return;
+	}
+
+	//nest * 2 + 1 if it stored, of the last access to every line
+	addrTable lastNest(lo, hi, total);
+	reuseState reuse;
+	std::map<pair<unsigned, unsigned>, struct nestReuse> found;
+	vector<long> buf(STREAM_BLOCK);
+	for(unsigned cur = 0; cur < nests.size(); cur++) {
+		vector<struct simAccess> &nest = nests[cur];
+		long size = 0;
+		vector<struct streamCursor> curs(nest.size());
+		for(unsigned a = 0; a < nest.size(); a++) {
+			if(nest[a].desc.size() > 0) {
+				curs[a] = nest[a].desc.cursorAt(0);
+			}
+			size = std::max(size, nest[a].desc.size());
+		}
+		//arrays already named for a producer, per access
+		vector<char> noted(nest.size() * nests.size(), 0);
+		vector<long> lines(nest.size() * STREAM_BLOCK);
+		for(long pos = 0; pos < size; pos += STREAM_BLOCK) {
+			long cnt = size - pos < STREAM_BLOCK ? size - pos : STREAM_BLOCK;
+			for(unsigned a = 0; a < nest.size(); a++) {
+				long m = std::min(cnt, nest[a].desc.size() - pos);
+				if(m <= 0) {
+					continue;
+				}
+				nest[a].desc.fill(curs[a], buf.data(), m);
+				for(long i = 0; i < m; i++) {
+					lines[a * STREAM_BLOCK + i] = (nest[a].base + buf[i]) >> shift;
+				}
+			}
+			for(long i = 0; i < cnt; i++) {
+				for(unsigned a = 0; a < nest.size(); a++) {
+					if(pos + i >= nest[a].desc.size()) {
+						continue;
+					}
+					long line = lines[a * STREAM_BLOCK + i];
+					long prev = lastNest.get(line);
+					long dist = reuse.touch(line);
+					lastNest.set(line, cur * 2 + (nest[a].store ? 1 : 0));
+					if(prev < 0 || prev / 2 == cur) {
+						continue;
+					}
+					unsigned producer = prev / 2;
+					struct nestReuse &nr = found[make_pair(producer, cur)];
+					nr.producer = producer;
+					nr.consumer = cur;
+					nr.lines++;
+					nr.written += prev % 2;
+					nr.distSum += dist;
+					if(dist >= capacityLines) {
+						nr.far++;
+					}
+					if(!noted[a * nests.size() + producer]) {
+						noted[a * nests.size() + producer] = 1;
+						nr.arrays.insert(nest[a].array);
+					}
+				}
+			}
+		}
+	}
+
+	for(auto &elem : found) {
+		pairs.push_back(elem.second);
+	}
+	std::stable_sort(pairs.begin(), pairs.end(), [](const struct nestReuse &a, const struct nestReuse &b) {
+		return a.far != b.far ? a.far > b.far : a.lines > b.lines;
+	});
+}
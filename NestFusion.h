@@ -0,0 +1,31 @@
+#ifndef _NESTFUSION_H_
+#define _NESTFUSION_H_
+
+#include "CacheSim.h"
+#include <set>
+#include <string>
+#include <vector>
+
+// Lines the consumer nest takes over from the producer nest, i.e. the
+// first access to the line in the consumer when its last access before was
+// in the producer. far counts those at a distance of at least the cache
+// capacity, which miss now and would hit if the nests were fused; written
+// counts those the producer stored to.
+struct nestReuse {
+	unsigned producer;
+	unsigned consumer;
+	long lines;
+	long written;
+	long far;
+	double distSum;
+	std::set<std::string> arrays;
+};
+
+// Runs the nests of a function in order, each with its accesses interleaved
+// in program order, through one stack of cache lines. The arrays are laid
+// out with placeArrays over the whole function. Only the accesses of a
+// nest that reach back to an earlier nest are attributed, so one sweep
+// gives every pair. pairs is sorted by far lines, most first.
+void crossNestReuse(vector<vector<struct simAccess>> &nests, unsigned lineBytes, long align, long capacityLines, vector<struct nestReuse> &pairs);
+
+#endif
@@ -13,10 +13,27 @@
 #include "llvm/Support/raw_ostream.h"
 #include "LoopUtils.h"
 #include "DervInd.h"
+#include "AddrClosure.h"
 #include "genGraph.h"
+#include "StreamDesc.h"
+#include "StreamPool.h"
+#include "StreamStats.h"
+#include "StreamFile.h"
+#include "StreamSample.h"
+#include "StrideModel.h"
+#include "CacheSim.h"
+#include "StreamDeps.h"
+#include "NestFusion.h"
+#include "StreamAnalysis.h"
+#include "StreamLog.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/JSON.h"
 #include "llvm/IR/InstIterator.h"
-#include <queue>
-#include <pthread.h>
+#include <cassert>
+#include <unordered_map>
 using namespace llvm;
 using namespace std;
 #define DEBUG_TYPE "assn1"
@@ -27,49 +44,51 @@ STATISTIC(StoreCounter, "Counts number of store instructions greeted");
 STATISTIC(LoopCounter, "Counts number of loops greeted");
 STATISTIC(BBCounter, "Counts number of basic blocks greeted");
 
+static cl::opt<bool> StreamPipeline("stream-pipeline", cl::init(false), cl::desc("Feed stream chunks to concurrent stride and reuse consumers instead of separate passes"));
+static cl::opt<bool> StreamReuse("stream-reuse", cl::init(true), cl::desc("Run reuse distance analysis on every stream"));
+static cl::opt<unsigned> StreamReuseParts("stream-reuse-parts", cl::init(0), cl::desc("Partitions the reuse analysis of a stream runs in on the pool (0 uses one per thread, 1 is serial)"));
+static cl::list<unsigned> StreamMRC("stream-mrc", cl::CommaSeparated, cl::desc("Cache sizes in KiB to print the LRU miss ratio curve of every enumerated access and loop nest at"));
+static cl::opt<double> StreamShardsRate("stream-shards-rate", cl::init(0.0), cl::desc("Estimate reuse from the addresses sampled at this rate by their hash (SHARDS) instead of tracking all of them (0 is exact)"));
+static cl::opt<unsigned> StreamShardsSize("stream-shards-size", cl::init(0), cl::desc("Estimate reuse by SHARDS tracking at most this many addresses, lowering the sampling rate as needed"));
+static cl::opt<bool> StreamMemo("stream-memo", cl::init(true), cl::desc("Reuse the analysis of an identical stream seen earlier in the module instead of enumerating it again"));
+static cl::opt<long> StreamBudget("stream-budget", cl::init(0), cl::desc("Sample streams longer than this many addresses instead of enumerating them (0 enumerates everything)"));
+static cl::opt<unsigned> StreamWindows("stream-windows", cl::init(64), cl::desc("Windows sampled per stream over the budget"));
+static cl::opt<bool> StreamStratified("stream-stratified", cl::init(true), cl::desc("Sample one window per equal stratum of the stream instead of anywhere"));
+static cl::opt<unsigned> StreamSeed("stream-seed", cl::init(1), cl::desc("Seed of the sampled window positions"));
+static cl::opt<bool> StreamClosedForm("stream-closed-form", cl::init(true), cl::desc("Derive the stride and reuse analyses of affine streams from scale factors and trip counts instead of enumerating them"));
+static cl::opt<bool> StreamStrideCheck("stream-stride-check", cl::init(false), cl::desc("Also enumerate every closed form stream and report whether both stride analyses agree"));
+enum streamGran { GranElement, GranByte, GranLine };
+static cl::opt<streamGran> StreamGran("stream-granularity", cl::init(GranElement), cl::desc("Unit of the stream addresses"),
+	cl::values(clEnumValN(GranElement, "element", "array element indices"),
+		clEnumValN(GranByte, "byte", "byte offsets using the DataLayout size of the accessed type"),
+		clEnumValN(GranLine, "line", "cache line numbers, consecutive accesses to one line collapsed")));
+static cl::opt<unsigned> StreamLine("stream-line", cl::init(64), cl::desc("Cache line size in bytes for -stream-granularity=line and -stream-fusion (32, 64 or 128)"));
+static cl::opt<std::string> StreamDMAFile("stream-dma-file", cl::init(""), cl::desc("Write a nested (count, stride) descriptor of every access per loop nest to this file, one JSON object per line"));
+static cl::opt<unsigned> StreamDMASegments("stream-dma-segments", cl::init(8), cl::desc("Patterns fitted to the remainder of a stream its main DMA pattern does not cover"));
+static cl::opt<bool> StreamCache("stream-cache", cl::init(false), cl::desc("Simulate a set associative cache over the accesses of every loop nest in program order"));
+static cl::opt<unsigned> StreamCacheSize("stream-cache-size", cl::init(32), cl::desc("Simulated cache size in KiB"));
+static cl::opt<unsigned> StreamCacheLine("stream-cache-line", cl::init(64), cl::desc("Simulated cache line size in bytes"));
+static cl::opt<unsigned> StreamCacheWays("stream-cache-ways", cl::init(8), cl::desc("Simulated cache associativity"));
+static cl::opt<cacheRepl> StreamCacheRepl("stream-cache-repl", cl::init(ReplLRU), cl::desc("Replacement policy of the simulated cache"),
+	cl::values(clEnumValN(ReplLRU, "lru", "least recently used"),
+		clEnumValN(ReplPLRU, "plru", "tree pseudo LRU"),
+		clEnumValN(ReplRandom, "random", "random way")));
+static cl::opt<bool> StreamCacheWriteAllocate("stream-cache-write-allocate", cl::init(true), cl::desc("Bring the line of a missing store into the simulated cache"));
+static cl::opt<unsigned> StreamCacheAlign("stream-cache-align", cl::init(4096), cl::desc("Alignment in bytes of the arrays laid out for cache simulation"));
+static cl::opt<bool> StreamFusion("stream-fusion", cl::init(false), cl::desc("Find the reuse between the loop nests of every function and rank fusing them by the memory traffic saved"));
+static cl::opt<unsigned> StreamFusionCache("stream-fusion-cache", cl::init(1024), cl::desc("Cache size in KiB beyond which a reuse between loop nests is counted as memory traffic"));
+static cl::opt<bool> StreamPrintLate("stream-print-late", cl::init(false), cl::desc("Print the streams of every function at the end of the optimization pipeline when loaded as a pass plugin"));
+static cl::opt<std::string> StreamDumpDir("stream-dump-dir", cl::init(""), cl::desc("Write every enumerated stream as a binary .stream file into this directory"));
+
 namespace {
-  #define NUM_TDS 16
   struct pathElem {
   	StringRef lab;
 	Instruction *inst;
   };
 
-  struct LoopData {
-  	Loop *lp;
-  	int initV;
-	int stepV;
-	int finalV;
-	
-	bool initCons;
-	StringRef initInd;
-	bool finalCons;
-	StringRef finalInd;
-	
-	StringRef indVar;
-
-	int scaleV;
-	int constV;
-	vector<int> scaleVV;
-	vector<int> constVV;
-	vector<int> modVV;
-	vector<vector<int>> opsVV;
-	vector<vector<int>> factsVV;
-	int hidFact;
-
-	int modInd;
-	int divInd;
-  };
-
   struct streamInfo {
   	char *name;
-	std::vector<int> addrs;
-  };
-
-  struct helperArgs {
-  	vector<struct LoopData*> compLoopV;
-	int factor;
-	int pno;
-	vector<int> addrsV;
+	StreamDescriptor desc;
   };
 
   struct streamProp {
@@ -77,219 +96,208 @@ namespace {
 	bool isIndirect;
 	bool isConstant;
 	int s_size;
+	//accessed array, whether the access stores and its place in the loop body
+	std::string array;
+	bool isStore;
+	unsigned order;
+	//what the analyses need once the IR is left behind; inst only keys the results
+	Instruction *inst;
+	std::string func;
+	int elemSize;
+	unsigned nest;
+	unsigned access;
+	std::vector<std::string> loopNames;
+	StreamDescriptor simDesc;
+	//the first access with a signature analyzes it, later ones take its memo
+	std::string sig;
+	bool owner;
+	std::string dumpPath;
+	//report of the closure and derivation, then of the stream analyses
+	std::string prelude;
+	std::string report;
+	std::string dmaLine;
+	struct dmaDesc dma;
+	bool reused;
+	flatHist reuseHist;
+	long reuseDistinct;
+  };
+
+  // A top level loop nest with its accesses in program order
+  struct nestSnap {
+	Loop *lp;
+	unsigned index;
+	std::vector<struct streamProp> accesses;
+	//dependences, cache simulation and miss ratio curve of the nest
+	std::string tail;
+  };
+
+  // Everything the stream analyses need of a function, taken from its IR in
+  // one serial pass, and the report they produce for it
+  struct funcSnap {
+	std::string name;
+	std::string head;
+	std::vector<struct nestSnap> nests;
+	std::string foot;
+  };
+
+  // Result of analyzing a stream, kept for later accesses with the same signature
+  struct streamMemo {
+  	char *name;
+	int s_size;
+	struct dmaDesc dma;
+	bool reused;
+	flatHist reuseHist;
+	long reuseDistinct;
   };
 
   struct Stat1Loop : public FunctionPass {
   		
 	  static char ID;
-	  map<Value*, struct streamProp> propMap;
-	  Stat1Loop() : FunctionPass(ID) {}
+	  //accesses of the loop nest being snapshotted, by their index in it
+	  DenseMap<Value*, unsigned> propMap;
+	  //address closures of the function being snapshotted
+	  closureCache closures;
+	  //names given to its unnamed arrays, kept in place for the StringRefs handed out
+	  std::map<AllocaInst*, std::string> unnamedArrays;
+	  unsigned dumpCount;
+	  //shared by all functions of the module, keyed by StreamDescriptor::signature
+	  std::unordered_map<std::string, struct streamMemo> memoMap;
+	  long memoHits;
+	  long memoMisses;
+	  //counted from the analyses running on the pool
+	  std::atomic<long> strideChecks;
+	  std::atomic<long> strideMismatches;
+	  std::unique_ptr<raw_fd_ostream> dmaOut;
+	  //filled with the streams of every loop nest when run for StreamAnalysis
+	  StreamAnalysis::Result *result;
+	  Stat1Loop() : FunctionPass(ID), dumpCount(0), memoHits(0), memoMisses(0), strideChecks(0), strideMismatches(0), result(nullptr) {}
 	  
 	  virtual void getAnalysisUsage(AnalysisUsage& AU) const override {
         	AU.addRequired<LoopInfoWrapperPass>();
 		AU.addRequired<ScalarEvolutionWrapperPass>();
     	  }
 
-	  std::map<StringRef, std::vector<int>> extractGEP(Instruction *inst) {
-	  	  std::map<StringRef, std::vector<int>> retMap;
-		  std::vector<int> dimsV;
-		
-		  GetElementPtrInst *gep = cast<GetElementPtrInst> (inst);
-		  Type *tp = gep->getSourceElementType();
-		  if(!tp->isArrayTy()) {
-		  	errs() << "Not array type, exiting\n";
-			exit(-1);
+	  //name of an array in the report and the stream names; unnamed ones are numbered in the function
+	  StringRef arrayName(AllocaInst *alloca) {
+		  if(alloca->hasName()) {
+			  return alloca->getName();
 		  }
-		  ArrayType *atp = cast<ArrayType> (tp);
-		  while(atp->getElementType()->isArrayTy()) {
-			  atp = cast<ArrayType> (atp->getElementType());
-			  dimsV.push_back(atp->getNumElements());
+		  auto found = unnamedArrays.find(alloca);
+		  if(found == unnamedArrays.end()) {
+			  found = unnamedArrays.insert(std::make_pair(alloca, "array" + std::to_string(unnamedArrays.size()))).first;
 		  }
-		  if(dimsV.empty()) {
-		  	dimsV.push_back(1);
-		  }
-		  //errs() << factor << " " << *tp << " ";
-
-		  std::map<StringRef, bool> visited;
-		  std::queue<Value*> valQ;
-
-
-		  Value *v;
-		  v = inst->getOperand(2);
-		  valQ.push(v);
-		  visited[v->getName()] = true;
-		  std::vector<StringRef> indV;
-		  while(!valQ.empty()) {
-			  v = valQ.front();
-			  valQ.pop();
-
-			  if(v->hasName() == false) {
-			  	continue;
-			  }
-
-			  Instruction *inst = cast<Instruction>(v);
-			  if(llvm::isa<llvm::PHINode>(*inst)) {
-			  	indV.push_back(v->getName());
-				break;
-			  }
-
-			  for(Use &U : inst->operands()) {
-				  v = U.get();
-				  if(v->getName().startswith("for") == true || v->getName().empty()) {
-					  continue;
-				  }
-				  if(visited.find(v->getName()) == visited.end()) {
-					  valQ.push(v);
-					  visited[v->getName()] = true;
-				  }
-			  }
-		  }
-
-		  for(StringRef ind : indV) {
-		  	//errs() << "Ind var " << ind << "\n";
-			retMap[ind] = dimsV;
-		  }
-
-		  return retMap;
+		  return found->second;
 	  }
 
-	  bool reverseClosure(llvm::BasicBlock::iterator &inst, std::map<StringRef, Value*> defsMap, StringRef &alloc, char *type, std::vector<StringRef> *visits, std::map<StringRef, std::vector<int>> &hidFact, bool &isIndirect, bool &isConstant) {
-	  	  std::queue<StringRef> labQ;
-		  int phiCounter = 0;
-		  std::map <StringRef, bool> visited;
-		  Value *v;
-		  if(llvm::isa <llvm::StoreInst> (*inst)) {
-		  	v = inst->getOperand(1);
-			strcpy(type, "store");
+	  //closure of the address of a load or store, false unless it reaches an array
+	  const struct addrClosure *reverseClosure(Instruction &inst, StringRef &alloc, char *type, bool &isIndirect, bool &isConstant) {
+		  Value *ptr;
+		  if(StoreInst *store = dyn_cast<StoreInst>(&inst)) {
+			  ptr = store->getPointerOperand();
+			  strcpy(type, "store");
 		  }
-		  else if(llvm::isa<llvm::LoadInst> (*inst)) {
-		  	v = inst->getOperand(0);
-			strcpy(type, "load");
+		  else {
+			  ptr = cast<LoadInst>(&inst)->getPointerOperand();
+			  strcpy(type, "load");
 		  }
-		  labQ.push(v->getName());
-		  visited[v->getName()] = true;
-
-		  while(!labQ.empty()) {
-		  	  StringRef v = labQ.front();
-			  visits->push_back(v);
-			  if(propMap.find(defsMap[v]) != propMap.end()) {
-			  	//errs() << "Indirect access\n";
-				isIndirect = true;
-				isConstant = false;
-				return true;
-			  }
-			  //errs() << v << " defined by " << *defsMap[v] << "\n";
-			  labQ.pop();
-			  Instruction* inst2 = cast<Instruction>(defsMap[v]);
-			  if(!inst2) {
-			  	continue;
-			  }
-
-			  if(llvm::isa <llvm::GetElementPtrInst> (*inst2)) {
-				  std::map<StringRef, std::vector<int>> factM = extractGEP(inst2);
-				  hidFact.insert(factM.begin(), factM.end()); 
-			  }
-			  if(llvm::isa <llvm::AllocaInst> (*inst2)) {
-				  alloc = v;
-				  //errs() << v << "\n";
-			  }
-			  else if(llvm::isa<llvm::PHINode>(*inst2)) {
-				  phiCounter++;
+		  const struct addrClosure &cl = closures.get(ptr);
+
+		  //an address computed from an earlier access of the nest is indirect
+		  AllocaInst *reached = nullptr;
+		  for(Instruction *v : cl.values) {
+			  if(propMap.find(v) != propMap.end()) {
+				  alloc = reached ? arrayName(reached) : StringRef();
+				  isIndirect = true;
+				  isConstant = false;
+				  return &cl;
 			  }
-
-
-			  for(Use &U : inst2->operands()) {
-			  	 Value *v = U.get();
-				 if(v->getName().startswith("for") == true || v->getName().empty()) {
-					 continue;
-				 }
-				 if(visited.find(v->getName()) == visited.end()) {
-				 	labQ.push(v->getName());
-					visited[v->getName()] = true;
-				 }
+			  if(AllocaInst *alloca = dyn_cast<AllocaInst>(v)) {
+				  reached = alloca;
 			  }
-
-		  }
-		  /*errs() << "All labels impacting the address in the instruction " << *inst << " are: ";
-		  for(std::pair<StringRef, bool> elem : visited) {
-		  	errs() << " " << elem.first;
-		  }*/
-		  
-		  
-		  //errs() << *inst << alloc << phiCounter << "\n";
-		  if((alloc.empty())) {
-		  	return false;
-		  }
-		  else if(phiCounter == 0) {
-		  	isConstant = true;
-		  	isIndirect = false;
-		  	return true;
 		  }
-		  else {
-		  	isConstant = false;
-		  	isIndirect = false;
-		  	return true;
+		  if(!cl.alloc) {
+			  return nullptr;
 		  }
+		  alloc = arrayName(cl.alloc);
+		  isIndirect = false;
+		  isConstant = cl.phis == 0;
+		  return &cl;
 	  }
 
-	  struct LoopData parseLoop(Loop *li, ScalarEvolution &SE, std::vector<struct LoopData> &loopDataV) {
-		  struct LoopData loopData;
-		  PHINode *phinode;
-
-		  phinode = li->getInductionVariable(SE);
+	  //false unless the loop has an induction variable, constant steps and bounds the streams can be derived for
+	  bool parseLoop(Loop *li, ScalarEvolution &SE, std::vector<struct LoopData> &loopDataV, struct LoopData &loopData) {
+		  PHINode *phinode = li->getInductionVariable(SE);
+		  llvm::Optional<Loop::LoopBounds> lbs = li->getBounds(SE);
+		  if(!phinode || !lbs) {
+			  return false;
+		  }
 		  //errs() << *phinode << "\n";
 
-		  Value* vInd = cast<Value>(phinode);
-		  loopData.indVar = vInd->getName();
+		  loopData.indVar = phinode;
 
 		  ConstantInt *Ci;
-		  llvm::Optional<Loop::LoopBounds> lbs = li->getBounds(SE);
 		  Value& vInit = (*lbs).getInitialIVValue();
-		  if(vInit.hasName()) {
+		  if(!isa<ConstantInt>(&vInit)) {
 			loopData.initCons = false;
 		  	//errs() << vInit << "\n";
-			Instruction *inst = cast<Instruction>(&vInit);
-			if(inst->getOpcode() == Instruction::Add) {
-				Ci = cast<ConstantInt>(inst->getOperand(1));
+			//starts at an outer induction variable itself unless offset by an add
+			loopData.initV = 0;
+			loopData.initInd = &vInit;
+			Instruction *inst = dyn_cast<Instruction>(&vInit);
+			if(inst && inst->getOpcode() == Instruction::Add) {
+				Ci = dyn_cast<ConstantInt>(inst->getOperand(1));
+				if(!Ci) {
+					return false;
+				}
 				loopData.initV = Ci->getSExtValue();
-				loopData.initInd = inst->getOperand(0)->getName();
-				//errs() << loopData.initInd << loopData.initV << "\n";
+				loopData.initInd = inst->getOperand(0);
+				//errs() << *loopData.initInd << loopData.initV << "\n";
 			}
 		  } else {
 			  Ci = cast<ConstantInt>(&vInit);
 			  loopData.initV = Ci->getSExtValue(); 
+			  loopData.initInd = nullptr;
 			  loopData.initCons = true;
 		  }
 		  //errs() << "Initialization of loop is " << loopData.initV << "\n";
 
 		  Value& vFinal = (*lbs).getFinalIVValue();
 		  //errs() << "final value " << vFinal << "\n";
-		  if(vFinal.hasName()) {
-		  	loopData.finalInd = vFinal.getName();
+		  if(!isa<ConstantInt>(&vFinal)) {
+		  	loopData.finalInd = &vFinal;
 			loopData.finalCons = false;
+			bool outer = false;
 			for(struct LoopData &lp: loopDataV) {
 				if(loopData.finalInd == lp.indVar) {
 					loopData.finalV = lp.finalV;
+					outer = true;
 					break;
 				}
 			}
+			//a trip count only known at run time
+			if(!outer) {
+				return false;
+			}
 		  }
 		  else {
 		  	Ci = cast<ConstantInt>(&vFinal);
 		  	loopData.finalV = Ci->getSExtValue();
+			loopData.finalInd = nullptr;
 			loopData.finalCons = true;
 		  }
-		  //errs() << loopData.finalInd << loopData.finalV << loopData.finalCons << "\n";
+		  //errs() << *loopData.finalInd << loopData.finalV << loopData.finalCons << "\n";
 		  //errs() << "Loop upper bound / goes upto " << loopData.finalV << "\n";
 
-		  Value* step = (*lbs).getStepValue();
-		  Ci = cast<ConstantInt>(step);
+		  Ci = dyn_cast_or_null<ConstantInt>((*lbs).getStepValue());
+		  if(!Ci) {
+			  return false;
+		  }
 		  loopData.stepV = Ci->getSExtValue(); 
 		  //errs() << "Step value of the loop is " << loopData.stepV << "\n";
 
 		  loopData.lp = li;
 
-		  return loopData;
+		  return true;
 
 	  }
 
@@ -330,100 +338,11 @@ namespace {
 			}
 		}
 
-		errs() << "Based on expression analysis " << fname << " has continuous strides of size " << stride << "\n";
+		streamLog() << "Based on expression analysis " << fname << " has continuous strides of size " << stride << "\n";
 		
 	  }
 
-	  static  void * computeHelper(void *arg) {
-		  struct helperArgs *args = (struct helperArgs*)arg;
-		  
-		  int psize = args->factor/NUM_TDS;
-		  int start = args->pno * psize;
-		  int end;
-		  if(args->pno == (NUM_TDS - 1)) {
-			  end = args->factor;
-		  }
-		  else {
-			  end = start + psize;
-		  }
-
-		  for(int count = start; count < end; count++) {
-			int pos = 0;
-			//std::vector<int> indList;
-			//std::map<StringRef, int> posIndMap;
-			for(struct LoopData *ldata : args->compLoopV) {
-				int indV = (count / ldata->divInd) % ldata->modInd;
-				//errs() << count << " " << ldata.divInd << " " << ldata.modInd << " " << indV << "\n";
-				//indList.push_back(indV);
-				int sum = 0;
-				for(unsigned i = 0; i < ldata->opsVV.size(); i++) {
-					int val = indV;
-					for(unsigned j = 0; j < ldata->opsVV[i].size(); j++) {
-						switch(ldata->opsVV[i][j]) {
-							case Oprs::Mul : val = val * ldata->factsVV[i][j]; break;
-							case Oprs::Add : val = val + ldata->factsVV[i][j]; break;
-							case Oprs::And : val = val & ldata->factsVV[i][j]; break;
-							case Oprs::Mod : val = val % ldata->factsVV[i][j]; break;
-							case Oprs::Rshift : val = val >> ldata->factsVV[i][j]; break;
-							default : errs() << "Error unknown operator found\n"; exit(1);
-						}
-					}
-					sum = sum + val * ldata->hidFact;
-				}
-				pos = pos + sum;
-			}
-		
-		        /*
-			//compute values of all surrounding loop ind vars
-			for(struct LoopData &ldata : allLoopData) {
-				int indV = (count / ldata.divInd) % ldata.modInd;
-				posIndMap[ldata.indVar] = indV;
-			}
-
-			
-			//check if finalV is compared with any indvar to filter stream addresses
-			//check if initV is assigned any indVar to filter stream addresses
-			int skip = false;
-			for(struct LoopData &ldata : allLoopData) {
-				if(ldata.finalCons == false) {
-					if(posIndMap[ldata.indVar] >= posIndMap[ldata.finalInd]) {
-						skip = true;
-						break;
-					}
-				}
-
-				if(ldata.initCons == false) {
-					if(posIndMap[ldata.indVar] < (posIndMap[ldata.initInd] + ldata.initV)) {
-						skip = true;
-						break;
-					}
-				}
-			}
-			if(!skip) {
-				sInfo.addrs.push_back(pos);
-			}
-			*/
-			args->addrsV.push_back(pos);
-
-			/*fprintf(fp, "%d", pos);
-			for(int indV : indList) {
-				fprintf(fp, " %d", indV);
-			}
-			fprintf(fp, "\n");*/
-		}
-
-		return NULL;
-	  }
-	  struct streamInfo computeStream(StringRef &func, StringRef &alloc, char *type, std::vector<struct LoopData> &allLoopData, std::vector<struct LoopData *> &compLoopV) {
-		int factor = 1;
-	  	for(int i = allLoopData.size() - 1; i >= 0; i--) {
-			struct LoopData *ldata = &allLoopData[i];
-			ldata->divInd = factor;
-			ldata->modInd = ldata->finalV;
-
-			factor = factor * ldata->finalV;
-		}
-		//errs() << factor << "\n";
+	  struct streamInfo computeStream(StringRef &func, StringRef &alloc, char *type, int elemSize, std::vector<struct LoopData> &allLoopData, std::vector<struct LoopData *> &compLoopV) {
 		char *name = &func.str()[0];
 		char *fname = (char *)malloc(256);
 		strcpy(fname, name);
@@ -433,326 +352,621 @@ namespace {
 		strcat(fname, "_");
 		strcat(fname, type);
 		strcat(fname, ".stream");
-		//FILE *fp = fopen(fname , "w");
 
 		struct streamInfo sInfo;
 		sInfo.name = fname;
-		
-		struct helperArgs args[NUM_TDS];
-		for(int i = 0; i < NUM_TDS; i++) {
-			args[i].compLoopV = compLoopV;
-			args[i].factor = factor;
-			args[i].pno = i;
-		}
-
-
-		pthread_t tids[NUM_TDS];
-		for(int i = 0; i < NUM_TDS; i++) {
-			pthread_create(&tids[i], NULL, computeHelper, &args[i]);
+		if(StreamGran == GranElement) {
+			sInfo.desc = StreamDescriptor(allLoopData, compLoopV);
 		}
-		for(int i = 0; i < NUM_TDS; i++) {
-			pthread_join(tids[i], NULL);
-		}
-
-
-		for(int i = 0; i < NUM_TDS; i++) {
-			for(int add : args[i].addrsV) {
-				sInfo.addrs.push_back(add);
-			}
+		else {
+			sInfo.desc = StreamDescriptor(allLoopData, compLoopV, elemSize, StreamGran == GranLine ? StreamLine : 0);
 		}
-		//fclose(fp);
 		return sInfo;
 	  }
 
-	  int enumStride(struct streamInfo &sInfo) {
-	  	int prevpos = sInfo.addrs[0];
-		int curpos;
-		int diff;
-		int conCt = 0;
-		std::map<int, int> oneStrideMap;
-		std::map<int, std::vector<int>> jumpMap;
-		int strideIn = 0;
-		for(unsigned i = 1; i < sInfo.addrs.size(); i++) {
-			curpos = sInfo.addrs[i];
-			diff = curpos - prevpos;
-			if(diff == 1) {
-				conCt++;
-			}
-			else if(diff == 0) {
-				continue;
-			}
-			else {
-				conCt++;
-				if(oneStrideMap.find(conCt) != oneStrideMap.end()) {
-					oneStrideMap[conCt] = oneStrideMap[conCt] + 1;
-				}
-				else {
-					oneStrideMap[conCt] = 1;
-				}
-				conCt = 0;
-
-
-				if(jumpMap.find(diff) != jumpMap.end()) {
-					std::vector<int> *posV = &jumpMap[diff];
-					posV->push_back(strideIn);
-				}
-				else {
-					std::vector<int> posV;
-					posV.push_back(strideIn);
-					jumpMap[diff] = posV;
-				}
-
-				strideIn++;
-
-			}
-
-			prevpos = curpos;
+	  void scanStride(struct streamInfo &sInfo, strideState &stride) {
+		long total = sInfo.desc.size();
+		long nchunks = (total + STREAM_GRAIN - 1) / STREAM_GRAIN;
+		std::vector<struct strideChunk> chunks(nchunks);
+		const StreamDescriptor &desc = sInfo.desc;
+		StreamPool::get().parallelFor(total, STREAM_GRAIN, [&desc, &chunks](long begin, long end) {
+			strideScan(desc, begin, end, chunks[begin / STREAM_GRAIN]);
+		});
+
+		//stitch the chunks in stream order, closing the runs that span chunk boundaries
+		for(struct strideChunk &chunk : chunks) {
+			stride.absorb(chunk);
 		}
+	  }
 
-		if(conCt != 0) {
-			conCt++;
-			if(oneStrideMap.find(conCt) != oneStrideMap.end()) {
-				oneStrideMap[conCt] = oneStrideMap[conCt] + 1;
-			}
-			else {
-				oneStrideMap[conCt] = 1;
-			}
-			conCt = 0;
+	  int enumStride(struct streamInfo &sInfo) {
+		if(sInfo.desc.size() == 0) {
+			return 1;
 		}
+		strideState stride(sInfo.desc.unit());
+		scanStride(sInfo, stride);
+		return stride.report(sInfo.name, sInfo.desc.size());
+	  }
 
-		errs() << "Stride analysis based on enumeration of " << sInfo.name << " which has total size "<< sInfo.addrs.size() << ":\n";
-		int minRet = INT_MAX;
-		for(auto &tup : oneStrideMap) {
-			errs() << tup.first << " size continuous substream occurs " << tup.second << " times \n"; 
-			if(minRet > tup.first) {
-				minRet = tup.first;
-			}
+	  //compares the closed form stride analysis with the enumerated one
+	  void checkStride(struct streamInfo &sInfo, strideState &closed) {
+		strideState stride(sInfo.desc.unit());
+		scanStride(sInfo, stride);
+		strideChecks++;
+		if(closed.matches(stride)) {
+			streamLog() << "Stride self-check of " << sInfo.name << ": closed form matches enumeration\n";
+			return;
 		}
+		strideMismatches++;
+		streamLog() << "Stride self-check of " << sInfo.name << ": closed form differs from enumeration\n";
+		stride.report(sInfo.name, sInfo.desc.size());
+	  }
 
-		errs() << "Jump analysis: ";
+	  //stack distances in one pass over the stream, O(n log n)
+	  void enumReuse(struct streamInfo &sInfo, reuseState &reuse) {
+		reuseScan(sInfo.desc, reuse, StreamReuseParts);
+		reuse.report(sInfo.name);
+	  }
 
-		for(auto &tup : jumpMap) {
-			errs() << tup.first << " : " << tup.second.size() << "\t";
+	  std::vector<long> curveSizes() {
+		std::vector<long> sizes;
+		for(unsigned kib : StreamMRC) {
+			sizes.push_back(kib * 1024L);
 		}
+		return sizes;
+	  }
 
-		errs() << "Done\n";
-
-		return minRet;
-
+	  //miss ratio curve of an access alone at the -stream-mrc sizes
+	  void reportCurve(struct streamProp &acc, const flatHist &hist, long distinct) {
+		long unitBytes = StreamGran == GranLine ? StreamLine : acc.elemSize;
+		struct missCurve curve = missCurveOf(hist, distinct, acc.sInfo.desc.size(), curveSizes(), unitBytes);
+		printMissCurve(acc.sInfo.name, curve);
 	  }
 
-	  int calcDist(std::vector<int> &addrs, int start, int end) {
-	  	std::map<int, bool> unqMap;
-		
-		for(int i = start + 1; i < end; i++) {
-			if(unqMap.find(addrs[i]) == unqMap.end()) {
-				unqMap[addrs[i]] = true;
-			}
-		}
-		
-		return unqMap.size();
+	  //the cache simulation, fusion and the nest miss ratio curve all run over the byte streams of a nest
+	  bool needSimDesc() {
+		  return StreamCache || StreamFusion || !StreamMRC.empty();
 	  }
-	  void enumReuse(struct streamInfo &sInfo) {
-	  	std::map<int, std::vector<int>> cacheMap;
-		std::map<int, int> distReuseMap;
 
+	  bool shardsReuse() {
+		  return StreamShardsRate > 0.0 || StreamShardsSize > 0;
+	  }
 
-		int cnt = 0;
-		for(int &curpos : sInfo.addrs) {
-			if(cacheMap.find(curpos) != cacheMap.end()) {
-				std::vector<int>* addrV = &cacheMap[curpos];
-				addrV->push_back(cnt);
-			}
-			else {
-				std::vector<int> addrV;
-				addrV.push_back(cnt);
-				cacheMap[curpos] = addrV;
-			}
-			cnt++;
-		}
+	  //reuse is only worth a pass of its own when it is split across the pool
+	  bool serialReuse() {
+		  return StreamReuseParts == 1 || (StreamReuseParts == 0 && StreamPool::get().size() == 1);
+	  }
 
-		for(auto &cache : cacheMap) {
-			std::vector<int> addrV = cache.second;
-			int prevpos = addrV[0];
-			for(unsigned i  = 1; i < addrV.size(); i++) {
-				int curpos = addrV[i];
-				int dist = calcDist(sInfo.addrs, prevpos, curpos);
-				if(distReuseMap.find(dist) != distReuseMap.end()) {
-					distReuseMap[dist] = distReuseMap[dist] + 1;
-				}
-				else {
-					distReuseMap[dist] = 1;
-				}
-				prevpos = curpos;
-			}
+	  //nested descriptor from the loop strides when affine, otherwise fitted to the addresses
+	  void computeDMA(struct streamInfo &sInfo, struct dmaDesc &dma) {
+		if(dmaClosedForm(sInfo.desc, dma)) {
+			return;
 		}
-		errs() << "Reuse analysis of " << sInfo.name << " : ";
-
-		float total = 0.0;
-		int weight = 0;
-		for(auto &tup : distReuseMap) {
-			//errs() << tup.first << " reuse distance occurs " << tup.second << " times \n"; 
-			total += tup.second;
-			weight += tup.first * tup.second;
-		
+		if(StreamBudget > 0 && sInfo.desc.size() > StreamBudget) {
+			//fitting enumerates the stream, which the budget rules out
+			dma.main.offset = 0;
+			dma.main.start = sInfo.desc.front();
+			dma.main.dims.clear();
+			dma.remainder.clear();
+			dma.unresolved = sInfo.desc.size();
+			return;
 		}
+		dmaFit(sInfo.desc, StreamDMASegments, dma);
+	  }
 
-		if(total > 0.0) {
-			errs() << (int)(weight/total) << " is the weighted reuse distance average\n";
-		}
-		else {
-			errs() << " No reuse in the stream\n";
+	  //line of the DMA file for an access, written when the reports are merged
+	  std::string dmaJSON(struct streamProp &acc, const struct dmaDesc &dma) {
+		auto patternJSON = [](const struct dmaPattern &p) {
+			json::Array dims;
+			for(auto &dim : p.dims) {
+				dims.push_back(json::Array{dim.first, dim.second});
+			}
+			return json::Object{{"offset", p.offset}, {"start", p.start}, {"dims", std::move(dims)}};
+		};
+		json::Array remainder;
+		for(const struct dmaPattern &p : dma.remainder) {
+			remainder.push_back(patternJSON(p));
 		}
-
-
+		const char *unit = StreamGran == GranLine ? "line" : (StreamGran == GranByte ? "byte" : "element");
+		json::Object obj{
+			{"function", acc.func},
+			{"nest", acc.nest},
+			{"access", acc.access},
+			{"array", acc.array},
+			{"type", acc.isStore ? "store" : "load"},
+			{"stream", acc.sInfo.name},
+			{"unit", unit},
+			{"size", acc.sInfo.desc.size()},
+			{"main", patternJSON(dma.main)},
+			{"remainder", std::move(remainder)},
+			{"unresolved", dma.unresolved}
+		};
+		std::string line;
+		raw_string_ostream out(line);
+		out << json::Value(std::move(obj)) << "\n";
+		return out.str();
 	  }
 
-	  struct streamProp analyzeStat(std::vector<struct LoopData> &loopDataV, StringRef &alloc, StringRef &func, char* type, ScalarEvolution &SE, std::vector<StringRef> &visits, std::map<StringRef, Value*> &defsMap, std::map<StringRef, std::vector<int>> &hidFact) {
-		  errs() << "Accessing " << alloc << " of type " << type << "\n";
+	  //derives the stream of an access from the IR and keeps what its analyses need
+	  void deriveStream(std::vector<struct LoopData> &loopDataV, StringRef &alloc, StringRef &func, char* type, int elemSize, ScalarEvolution &SE, const struct addrClosure &closure, struct streamProp &sProp) {
+		  streamLog() << "Accessing " << alloc << " of type " << type << "\n";
 		  std::vector<struct LoopData*> compLoopV;
 		  for(struct LoopData &ldata : loopDataV) {
-			  map<Value*, tuple<Value*, vector<int>, vector<int> >> IndVarMap = getDerived(loopDataV[0].lp, ldata.lp, SE, visits);
+			  map<Value*, tuple<Value*, vector<int>, vector<int> >> IndVarMap = getDerived(loopDataV[0].lp, ldata.lp, SE, closure.members);
 			  bool lpAdded = false;
 			  ldata.factsVV.clear();
 			  ldata.opsVV.clear();
-			  for(StringRef visit : visits) {
-				  if(IndVarMap.find(defsMap[visit]) != IndVarMap.end()) {
+			  for(Instruction *visit : closure.values) {
+				  if(IndVarMap.find(visit) != IndVarMap.end()) {
 				  	  
-					  //errs() << " with " << visit << " as the dervied induction variable considering innermost loop's base induction variable is " << ldata.indVar;
-					  tuple<Value*, vector<int>, vector<int>> tup = IndVarMap[defsMap[visit]];
+					  //streamLog() << " with " << visit << " as the dervied induction variable considering innermost loop's base induction variable is " << ldata.indVar;
+					  tuple<Value*, vector<int>, vector<int>> tup = IndVarMap[visit];
 					  Value *base = get<0>(tup);
 					  vector<int> factsV = get<1>(tup);
 					  vector<int> opsV = get<2>(tup);
 					  struct LoopData *lp = &ldata;
-					  errs() << base->getName();
-					  int fact = 1;
-					  for(int dim : hidFact[ldata.indVar]) {
-					  	//errs() << " * ";
-						//errs() << dim;
-						fact = fact * dim;
+					  streamLog() << base->getName();
+					  long fact = 1;
+					  auto dims = closure.hidFact.find(ldata.indVar);
+					  if(dims != closure.hidFact.end()) {
+						  for(int dim : dims->second) {
+							fact = fact * dim;
+						  }
 					  }
 					  ldata.factsVV.push_back(factsV);
 					  ldata.opsVV.push_back(opsV);
 					  for(unsigned i = 0; i < factsV.size(); i++) {
-					  	errs() << " ";
+					  	streamLog() << " ";
 						switch(opsV[i]) {
-							case Oprs::Add : errs() << "+"; break;
-							case Oprs::Mul : errs() << "*"; break;
-							case Oprs::And : errs() << "&"; break;
-							case Oprs::Rshift : errs() << ">>"; break;
-							case Oprs::Mod : errs() << "%"; break;
+							case Oprs::Add : streamLog() << "+"; break;
+							case Oprs::Mul : streamLog() << "*"; break;
+							case Oprs::And : streamLog() << "&"; break;
+							case Oprs::Rshift : streamLog() << ">>"; break;
+							case Oprs::Mod : streamLog() << "%"; break;
 						}
 						
-						errs() << " " << factsV[i];
+						streamLog() << " " << factsV[i];
 					  }
 
-					  errs() << " + ";
+					  streamLog() << " + ";
 
 					  ldata.hidFact = fact;
 					  if(!lpAdded) {
 					  	compLoopV.push_back(lp);
 					  }
 					  lpAdded = true;
-					  //errs() << " dervied from base variable " << base->getName() << " with scale of " << ldata.scaleV << " and constant of " << ldata.constV << "\n";
+					  //streamLog() << " dervied from base variable " << base->getName() << " with scale of " << ldata.scaleV << " and constant of " << ldata.constV << "\n";
 					  //break;
 				  }
 			  }
 		 }
 
-		 errs() << "\b\b \n";
+		 streamLog() << "\b\b \n";
 
-		 struct streamProp sProp;
-		 struct streamInfo sInfo;
-		 sInfo = computeStream(func, alloc, type, loopDataV, compLoopV);
-		 errs() << "Computed stream of addresses\n";
-		 //exprStride(loopDataV, compLoopV, sInfo.name);
-		 int size = enumStride(sInfo);
-		  
- 		 sProp.sInfo = sInfo;
-		 sProp.s_size = size;
-		 //enumReuse(sInfo);
-		 return sProp;
+		 sProp.sInfo = computeStream(func, alloc, type, elemSize, loopDataV, compLoopV);
+		 streamLog() << "Computed stream descriptor\n";
+		 sProp.func = func.str();
+		 sProp.elemSize = elemSize;
+		 for(struct LoopData &ldata : loopDataV) {
+			 sProp.loopNames.push_back(ldata.indVar->hasName() ? ldata.indVar->getName().str() : "at depth " + std::to_string(sProp.loopNames.size()));
+		 }
+		 if(needSimDesc()) {
+			 sProp.simDesc = StreamDescriptor(loopDataV, compLoopV, elemSize);
+		 }
 	  }
 
-	  void analyzeDeps() {
-	  	map<Value*, bool> visited;
-		for(auto elem : propMap) {
-			if(elem.second.isIndirect == true || elem.second.isConstant == true) {
-				visited[elem.first] = true;
+	  //stride, reuse and DMA analyses of a stream, on any thread: all they need is in acc
+	  void analyzeStream(struct streamProp &acc) {
+		 struct streamInfo &sInfo = acc.sInfo;
+		 if(dmaOut) {
+			 computeDMA(sInfo, acc.dma);
+			 acc.dmaLine = dmaJSON(acc, acc.dma);
+		 }
+		 std::string &dumpPath = acc.dumpPath;
+
+		 int size = 1;
+		 //affine streams get their stride analysis without enumeration
+		 struct strideChunk closed;
+		 bool analytic = StreamClosedForm && strideClosedForm(sInfo.desc, closed);
+		 if(analytic) {
+			 strideState stride(sInfo.desc.unit());
+			 stride.absorb(closed);
+			 size = stride.report(sInfo.name, sInfo.desc.size(), "the closed form");
+			 if(StreamStrideCheck) {
+				 checkStride(sInfo, stride);
+			 }
+		 }
+
+		 reuseState reuse;
+		 shardsState shards(StreamShardsRate > 0.0 ? StreamShardsRate : 1.0, StreamShardsSize);
+		 bool reused = false;
+		 flatHist reuseHist;
+		 long reuseDistinct = 0;
+		 std::vector<struct reuseCarried> carried;
+		 bool analyticReuse = StreamReuse && StreamClosedForm && reuseClosedForm(sInfo.desc, carried, reuseDistinct);
+		 if(analyticReuse) {
+			 std::map<long, long> distReuseMap;
+			 for(struct reuseCarried &rc : carried) {
+				 streamLog() << "Reuse of " << sInfo.name << " carried by loop " << acc.loopNames[rc.loop] << " : distance " << rc.distance << " occurs " << rc.count << " times\n";
+				 reuseHist.add(rc.distance, rc.count);
+				 distReuseMap[rc.distance] += rc.count;
+			 }
+			 printReuse(sInfo.name, distReuseMap);
+			 reused = true;
+		 }
+		 //what is left to enumerate or sample for reuse
+		 bool needReuse = StreamReuse && !analyticReuse;
+		 if(StreamBudget > 0 && sInfo.desc.size() > StreamBudget) {
+			 //too large to enumerate within the budget, so extrapolate from windows
+			 std::vector<struct sampleWindow> windows = pickWindows(sInfo.desc.size(), StreamBudget, StreamWindows, StreamStratified, StreamSeed);
+			 if(!dumpPath.empty()) {
+				 streamLog() << "Not writing " << dumpPath << ", the stream is sampled\n";
+			 }
+			 if(!analytic) {
+				 size = sampleStride(sInfo.desc, sInfo.name, windows);
+			 }
+			 if(needReuse && shardsReuse()) {
+				 //spatial sampling needs every access, but in bounded memory
+				 std::vector<struct streamConsumer*> consumers(1, &shards);
+				 pipeStream(sInfo.desc, consumers);
+				 shards.report(sInfo.name);
+				 reused = true;
+			 }
+			 else if(needReuse) {
+				 sampleReuse(sInfo.desc, sInfo.name, windows);
+			 }
+			 if(!reused && !StreamMRC.empty()) {
+				 streamLog() << "No miss ratio curve of " << sInfo.name << ", the stream is sampled\n";
+			 }
+		 }
+		 else if(StreamPipeline) {
+			 strideState stride(sInfo.desc.unit());
+			 streamWriter writer;
+			 std::vector<struct streamConsumer*> consumers;
+			 if(!analytic) {
+				 consumers.push_back(&stride);
+			 }
+			 if(needReuse && shardsReuse()) {
+				 consumers.push_back(&shards);
+			 }
+			 else if(needReuse && serialReuse()) {
+				 consumers.push_back(&reuse);
+			 }
+			 if(!dumpPath.empty() && writer.open(dumpPath.c_str(), sInfo.name, sInfo.desc.unit())) {
+				 consumers.push_back(&writer);
+			 }
+			 if(!consumers.empty()) {
+				 pipeStream(sInfo.desc, consumers);
+			 }
+			 writer.close();
+			 if(!analytic) {
+				 size = stride.report(sInfo.name, sInfo.desc.size());
+			 }
+			 if(needReuse && shardsReuse()) {
+				 shards.report(sInfo.name);
+			 }
+			 else if(needReuse && serialReuse()) {
+				 reuse.report(sInfo.name);
+			 }
+			 else if(needReuse) {
+				 enumReuse(sInfo, reuse);
+			 }
+			 reused = StreamReuse;
+		 }
+		 else {
+			 if(!dumpPath.empty()) {
+				 writeStream(sInfo.desc, dumpPath.c_str(), sInfo.name);
+			 }
+			 if(!analytic) {
+				 size = enumStride(sInfo);
+			 }
+			 if(needReuse && shardsReuse()) {
+				 std::vector<struct streamConsumer*> consumers(1, &shards);
+				 pipeStream(sInfo.desc, consumers);
+				 shards.report(sInfo.name);
+			 }
+			 else if(needReuse) {
+				 enumReuse(sInfo, reuse);
+			 }
+			 reused = StreamReuse;
+		 }
+		 if(reused && !StreamMRC.empty()) {
+			 //the closed form filled both already
+			 if(!analyticReuse && shardsReuse()) {
+				 shards.histogram(reuseHist, reuseDistinct);
+			 }
+			 else if(!analyticReuse) {
+				 reuseHist = reuse.histogram();
+				 reuseDistinct = reuse.distinct();
+			 }
+			 reportCurve(acc, reuseHist, reuseDistinct);
+		 }
+		 acc.s_size = size;
+		 acc.reused = reused;
+		 acc.reuseHist = std::move(reuseHist);
+		 acc.reuseDistinct = reuseDistinct;
+	  }
+
+	  //takes the analysis of an identical stream analyzed before
+	  void reuseMemo(struct streamProp &acc) {
+		 //runs on the pool, so the map is only read; the serial pass filled it
+		 auto found = memoMap.find(acc.sig);
+		 assert(found != memoMap.end() && "memo of a repeated stream was not recorded");
+		 const struct streamMemo &memo = found->second;
+		 streamLog() << "Stream " << acc.sInfo.name << " is identical to " << memo.name << "; reusing its analysis with smallest continuous substream of " << memo.s_size << "\n";
+		 if(dmaOut) {
+			 acc.dmaLine = dmaJSON(acc, memo.dma);
+		 }
+		 if(memo.reused && !StreamMRC.empty()) {
+			 reportCurve(acc, memo.reuseHist, memo.reuseDistinct);
+		 }
+		 //offline analyses read every access from the dump, so it is written all the same
+		 if(!acc.dumpPath.empty()) {
+			 if(StreamBudget > 0 && acc.sInfo.desc.size() > StreamBudget) {
+				 streamLog() << "Not writing " << acc.dumpPath << ", the stream is sampled\n";
+			 }
+			 else {
+				 writeStream(acc.sInfo.desc, acc.dumpPath.c_str(), acc.sInfo.name);
+			 }
+		 }
+		 acc.s_size = memo.s_size;
+	  }
+
+	  void simulateCache(std::string &func, unsigned nest, std::vector<struct simAccess> &nestSim) {
+		long total = 0;
+		for(struct simAccess &acc : nestSim) {
+			total += acc.desc.size();
+		}
+		if(StreamBudget > 0 && total > StreamBudget) {
+			streamLog() << "Not simulating loop nest " << nest << " of " << func << ", its " << total << " accesses exceed the budget\n";
+			return;
+		}
+		struct cacheConfig config;
+		config.size = StreamCacheSize * 1024L;
+		config.line = StreamCacheLine;
+		config.ways = StreamCacheWays;
+		config.repl = StreamCacheRepl;
+		config.writeAllocate = StreamCacheWriteAllocate;
+		placeArrays(nestSim, StreamCacheAlign);
+		std::vector<struct cacheCounts> counts;
+		simulateNest(config, nestSim, counts);
+		struct cacheCounts sum = {0, 0, 0, 0};
+		for(unsigned k = 0; k < nestSim.size(); k++) {
+			printCacheCounts(nestSim[k].name, counts[k]);
+			sum.hits += counts[k].hits;
+			sum.misses += counts[k].misses;
+			sum.cold += counts[k].cold;
+			sum.conflicts += counts[k].conflicts;
+		}
+		std::string nestName = "loop nest " + std::to_string(nest) + " of " + func;
+		printCacheCounts(nestName.c_str(), sum);
+	  }
+
+	  //the accesses of a nest share the cache, so its curve comes from one reuse pass over them in program order
+	  void reportNestCurve(std::string &func, unsigned nest, std::vector<struct simAccess> &nestSim) {
+		long total = 0;
+		long unitBytes = LONG_MAX;
+		for(struct simAccess &acc : nestSim) {
+			total += acc.desc.size();
+			unitBytes = std::min(unitBytes, (long)acc.elemSize);
+		}
+		if(StreamGran == GranLine) {
+			unitBytes = StreamLine;
+		}
+		else if(StreamGran == GranByte) {
+			unitBytes = 1;
+		}
+		std::string nestName = "loop nest " + std::to_string(nest) + " of " + func;
+		if(StreamBudget > 0 && total > StreamBudget) {
+			streamLog() << "Not computing the miss ratio curve of " << nestName << ", its " << total << " accesses exceed the budget\n";
+			return;
+		}
+		placeArrays(nestSim, StreamCacheAlign);
+		reuseState reuse;
+		interleaveNest(nestSim, unitBytes, reuse);
+		struct missCurve curve = missCurveOf(reuse.histogram(), reuse.distinct(), total, curveSizes(), unitBytes);
+		printMissCurve(nestName.c_str(), curve);
+	  }
+
+	  //loop nest pairs of the function by the lines fusing them would keep in cache
+	  void adviseFusion(std::string &func, std::vector<std::vector<struct simAccess>> &funcNests) {
+		long total = 0;
+		for(auto &nest : funcNests) {
+			for(struct simAccess &acc : nest) {
+				total += acc.desc.size();
 			}
-			else {
-				visited[elem.first] = false;
+		}
+		if(StreamBudget > 0 && total > StreamBudget) {
+			streamLog() << "Not looking for loop fusion in " << func << ", its " << total << " accesses exceed the budget\n";
+			return;
+		}
+		long lineBytes = StreamLine;
+		std::vector<struct nestReuse> pairs;
+		crossNestReuse(funcNests, lineBytes, StreamCacheAlign, StreamFusionCache * 1024L / lineBytes, pairs);
+		if(pairs.empty()) {
+			streamLog() << "No reuse between the loop nests of " << func << "\n";
+			return;
+		}
+		streamLog() << "Loop fusion candidates in " << func << " by memory traffic saved with a " << StreamFusionCache << "K cache:\n";
+		for(struct nestReuse &nr : pairs) {
+			streamLog() << "Loop " << nr.producer + 1 << " -> loop " << nr.consumer + 1 << " :";
+			for(const std::string &array : nr.arrays) {
+				streamLog() << " " << array;
 			}
+			streamLog() << " ; " << nr.lines << " lines reused (" << nr.written << " written by loop " << nr.producer + 1 << ") at average distance " << (long)(nr.distSum / nr.lines) << " lines; fusing saves " << nr.far * lineBytes << " bytes\n";
 		}
-		
-		vector<vector<struct streamProp>> matchVV;
-		for(auto elem : propMap) {
-			if(visited[elem.first] == true) {
+	  }
+
+	  void analyzeDeps(struct nestSnap &nest) {
+		//streams grouped by name in order of first appearance, without copies
+		std::unordered_map<std::string, unsigned> groupOf;
+		vector<vector<const struct streamProp*>> matchVV;
+		std::map<std::string, vector<const struct streamProp*>> arrays;
+		for(const struct streamProp &sProp : nest.accesses) {
+			if(sProp.isIndirect == true || sProp.isConstant == true) {
 				continue;
 			}
-			visited[elem.first] = true;
-			char *first = elem.second.sInfo.name;
-			vector<struct streamProp> matchV;
-			matchV.push_back(elem.second);
-			for(auto elem2 : propMap) {
-				if(visited[elem2.first] == true) {
-					continue;
-				}
-				if(strcmp(first, elem2.second.sInfo.name) == 0) {
-					visited[elem2.first] = true;
-					matchV.push_back(elem2.second);
-				}
+			auto found = groupOf.insert(std::make_pair(std::string(sProp.sInfo.name), (unsigned)matchVV.size()));
+			if(found.second) {
+				matchVV.push_back(vector<const struct streamProp*>());
 			}
-			matchVV.push_back(matchV);
+			matchVV[found.first->second].push_back(&sProp);
+			arrays[sProp.array].push_back(&sProp);
 		}
 
-		for(auto matchV : matchVV) {
+		for(auto &matchV : matchVV) {
 			if(matchV.size() > 1) {
-				errs() << matchV[0].sInfo.name << " occurs " << matchV.size()  << " times ";
-				int start = INT_MAX, end = INT_MIN;
+				streamLog() << matchV[0]->sInfo.name << " occurs " << matchV.size()  << " times ";
+				//the range takes a pass over every stream, the first and last address are not its ends
+				if(StreamBudget > 0 && matchV[0]->sInfo.desc.size() > StreamBudget) {
+					streamLog() << "\nNo cumulative range, the streams exceed the budget\n";
+					continue;
+				}
+				long start = LONG_MAX, end = LONG_MIN;
 				int count = 1;
-				for(auto sProp : matchV) {
-					if(start > sProp.sInfo.addrs[0]) {
-						start = sProp.sInfo.addrs[0];
-					}
-					
-					if(end < sProp.sInfo.addrs.back()) {
-						end = sProp.sInfo.addrs.back();
+				for(const struct streamProp *sProp : matchV) {
+					long first = LONG_MAX, last = LONG_MIN;
+					streamRange(sProp->sInfo.desc, first, last);
+					if(sProp->sInfo.desc.size() == 0) {
+						streamLog() << " Stream " << count << ":[] ";
+						count++;
+						continue;
 					}
+					start = std::min(start, first);
+					end = std::max(end, last);
 
-					errs() << " Stream " << count << ":[" << sProp.sInfo.addrs[0] << "-" << sProp.sInfo.addrs.back() << "] ";
+					streamLog() << " Stream " << count << ":[" << first << "-" << last << "] ";
 					count++;
 				}
 
-				errs() << "\nCumulative: start=" << start << " end=" << end << " with window size of " << matchV[0].sInfo.addrs.size() << "\n";
+				if(start > end) {
+					streamLog() << "\nCumulative: empty with window size of 0\n";
+					continue;
+				}
+				streamLog() << "\nCumulative: start=" << start << " end=" << end << " with window size of " << matchV[0]->sInfo.desc.size() << "\n";
 
 			}
 		}
-	  }
-	  bool runOnFunction(Function &F) override {
-		errs() << "\nFunction name : " << F.getName() << "\n";
-		InstCounter = 0;
-		LoadCounter = 0;
-		StoreCounter = 0;
-		std::map<StringRef, Value*> defsMap;
-		for(inst_iterator itr = inst_begin(F), etr = inst_end(F); itr != etr; itr++) {
-			InstCounter++;
 
-			for (Use &U : itr->operands()) {
-				Value *v = U.get();
-				if(v->hasName() == false) {
+		//every other access of an array against each store to it, both in program order
+		for(auto &arr : arrays) {
+			vector<const struct streamProp*> &accV = arr.second;
+			for(const struct streamProp *store : accV) {
+				if(!store->isStore || accV.size() < 2) {
 					continue;
 				}
-				
-				if(v->getName().startswith("for") == true) {
+				if(StreamBudget > 0 && store->sInfo.desc.size() > StreamBudget) {
+					streamLog() << "Not computing dependences on " << store->sInfo.name << ", the stream exceeds the budget\n";
 					continue;
 				}
-
-				if(defsMap.find(v->getName()) != defsMap.end()) {
-					continue;
+				vector<const StreamDescriptor*> others;
+				vector<bool> before;
+				vector<const struct streamProp*> otherProps;
+				for(const struct streamProp *acc : accV) {
+					if(acc != store) {
+						others.push_back(&acc->sInfo.desc);
+						before.push_back(acc->order < store->order);
+						otherProps.push_back(acc);
+					}
 				}
-				defsMap.insert(std::pair<StringRef, Value*>(v->getName(), v));
+				vector<struct streamDep> deps;
+				streamDeps(store->sInfo.desc, others, before, deps);
+				for(unsigned k = 0; k < deps.size(); k++) {
+					streamLog() << "Dependence of " << otherProps[k]->sInfo.name << " (access " << otherProps[k]->order << ") on " << store->sInfo.name << " (access " << store->order << ") : " << deps[k].overlap << " common addresses";
+					if(deps[k].flows > 0) {
+						streamLog() << ", " << deps[k].flows << " accesses after the write at " << deps[k].minDist << " to " << deps[k].maxDist << " iterations\n";
+					}
+					else {
+						streamLog() << ", no access after the write\n";
+					}
+				}
+			}
+		}
+	  }
+	  //copies the accesses of every loop nest into the result in program order
+	  void recordStreams(struct funcSnap &snap) {
+		result->report = snap.head;
+		for(struct nestSnap &nest : snap.nests) {
+			struct loopStreams streams;
+			streams.loop = nest.lp;
+			for(struct streamProp &sProp : nest.accesses) {
+				result->report += sProp.prelude + sProp.report;
+				result->dma += sProp.dmaLine;
+				struct accessStream acc;
+				acc.inst = sProp.inst;
+				acc.array = sProp.array;
+				acc.isStore = sProp.isStore;
+				acc.isIndirect = sProp.isIndirect;
+				acc.isConstant = sProp.isConstant;
+				acc.s_size = 1;
+				if(!sProp.isIndirect && !sProp.isConstant) {
+					acc.name = sProp.sInfo.name;
+					acc.desc = sProp.sInfo.desc;
+					acc.s_size = sProp.s_size;
+				}
+				streams.accesses.push_back(std::move(acc));
+			}
+			result->loops.push_back(std::move(streams));
+			result->report += nest.tail;
+		}
+		result->report += snap.foot;
+	  }
+
+	  bool runOnFunction(Function &F) override {
+		analyzeFunction(F, getAnalysis<LoopInfoWrapperPass>().getLoopInfo(), getAnalysis<ScalarEvolutionWrapperPass>().getSE());
+		return false;
+	  }
+
+	  void analyzeFunction(Function &F, LoopInfo &Li, ScalarEvolution &SE) {
+		std::vector<struct funcSnap> funcs(1);
+		snapshotFunction(F, Li, SE, funcs[0]);
+		analyzeSnapshots(funcs);
+		//StreamAnalysis keeps the report for its printer instead
+		if(result) {
+			recordStreams(funcs[0]);
+		}
+		else {
+			printSnapshot(funcs[0]);
+		}
+	  }
+
+	  //walks the IR of a function once, keeping its loop nests and the streams of their accesses
+	  void snapshotFunction(Function &F, LoopInfo &Li, ScalarEvolution &SE, struct funcSnap &snap) {
+		if((StreamGran == GranLine || StreamFusion) && StreamLine != 32 && StreamLine != 64 && StreamLine != 128) {
+			errs() << "Error line size " << StreamLine << " is not 32, 64 or 128 bytes\n";
+			exit(1);
+		}
+		if(StreamShardsRate < 0.0 || StreamShardsRate > 1.0) {
+			errs() << "Error SHARDS sampling rate " << StreamShardsRate << " is not between 0 and 1\n";
+			exit(1);
+		}
+		if(StreamCache) {
+			long lines = StreamCacheSize * 1024L / (StreamCacheLine > 0 ? StreamCacheLine : 1);
+			long sets = StreamCacheWays > 0 ? lines / StreamCacheWays : 0;
+			if(StreamCacheLine == 0 || (StreamCacheLine & (StreamCacheLine - 1)) != 0 || sets == 0 || (sets & (sets - 1)) != 0 || sets * StreamCacheWays != lines) {
+				errs() << "Error simulated cache of " << StreamCacheSize << "K with " << StreamCacheLine << " byte lines and " << StreamCacheWays << " ways needs a power of two line size and number of sets\n";
+				exit(1);
+			}
+			if(StreamCacheRepl == ReplPLRU && ((StreamCacheWays & (StreamCacheWays - 1)) != 0 || StreamCacheWays > 64)) {
+				errs() << "Error PLRU needs a power of two associativity up to 64, not " << StreamCacheWays << "\n";
+				exit(1);
+			}
+			if(StreamCacheAlign == 0) {
+				errs() << "Error array alignment must be at least one byte\n";
+				exit(1);
 			}
+		}
+		std::string text;
+		streamLogTo log(text);
+		snap.name = F.getName().str();
+		streamLog() << "\nFunction name : " << F.getName() << "\n";
+		InstCounter = 0;
+		LoadCounter = 0;
+		StoreCounter = 0;
+		closures.clear();
+		unnamedArrays.clear();
+		for(inst_iterator itr = inst_begin(F), etr = inst_end(F); itr != etr; itr++) {
+			InstCounter++;
 
 			if(llvm::isa <llvm::StoreInst> (*itr)) {
 				StoreCounter++;
@@ -765,84 +979,279 @@ namespace {
 
       		}
 
+		snap.head = log.take();
 		LoopCounter = 0;
-		LoopInfo &Li = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
 		struct LoopData loopData;
-		ScalarEvolution &SE = getAnalysis<ScalarEvolutionWrapperPass>().getSE(); 
-		std::map<StringRef, bool> allocVMap;
 		for(Loop *lit : Li) {
 			propMap.clear();
-			std::vector<struct LoopData> loopDataV;
 			LoopCounter++;
-			genGraph graphVal;
-			map<Value*, int> strideMap;
-			loopData = parseLoop(lit, SE, loopDataV);		
-			loopDataV.push_back(loopData);
+			snap.nests.push_back(nestSnap());
+			struct nestSnap &nest = snap.nests.back();
+			nest.lp = lit;
+			nest.index = LoopCounter;
+			unsigned nestAccess = 0;
+			std::vector<struct LoopData> loopDataV;
 			std::unique_ptr<LoopNest> lnest = LoopNest::getLoopNest(*lit, SE); 
-			Loop *lin = lit;
-			for(unsigned int i = 1; i < lnest->getNumLoops(); i++) {
-				lin = lnest->getLoop(i);
-				loopData = parseLoop(lin, SE, loopDataV);		
+			bool parsed = true;
+			for(unsigned int i = 0; i < lnest->getNumLoops() && parsed; i++) {
+				parsed = parseLoop(lnest->getLoop(i), SE, loopDataV, loopData);
 				loopDataV.push_back(loopData);
 			}
-			for(BasicBlock *BB : lit->getBlocks())
-                	{
-                    		//errs() << "basicb name: "<< BB->getName() <<"\n";
-				if(true) { //BB->getName().startswith("for.body")) {
-					for (BasicBlock::iterator itr = BB->begin(), e = BB->end(); itr != e; ++itr) {
-						if(llvm::isa <llvm::StoreInst> (*itr) || llvm::isa<llvm::LoadInst> (*itr)) {
-							StringRef alloc;
-							StringRef func = F.getName();
-							char type[16];
-							std::vector<StringRef> visits;
-							std::map<StringRef, std::vector<int>> hidFact;
-							bool isIndirect;
-							bool isConstant;
-							if(reverseClosure(itr, defsMap, alloc, type, &visits, hidFact, isIndirect, isConstant) == true) {
-								/*if(allocVMap.find(alloc) != allocVMap.end()) {
-									continue;
-								}
-								allocVMap[alloc] = true;
-								*/
-								Value *vl = cast<Value>(itr);
-								struct streamProp sProp;
-								if(isIndirect == false && isConstant == false) {
-									sProp = analyzeStat(loopDataV, alloc, func, type, SE, visits, defsMap, hidFact);
-									//errs() << "Load/Store inst is " << *vl << " accessing "<< alloc << " of type " << type << "\n";
-									strideMap[vl] = sProp.s_size;
-								}
-								else if(isIndirect == true) {
-		  							errs() << "Indirect access " << alloc << " of type " << type << "; cannot enumrate stream addresses\n";
-									strideMap[vl] = 1;
-								}
-								else if(isConstant == true) {
-		  							errs() << "Constant address access " << alloc << " of type " << type << "\n";
-									strideMap[vl] = 1;
-								}
-								sProp.isIndirect = isIndirect;
-								sProp.isConstant = isConstant;
-								propMap[vl] = sProp;
-								//graphVal.addToGraph(vl, alloc, type);
-							}
+			if(!parsed) {
+				//its accesses cannot be enumerated, so the nest is left without streams
+				streamLog() << "Loop " << nest.index << " of " << F.getName() << " is not in canonical form with constant bounds, skipping its accesses\n";
+				nest.tail = log.take();
+				continue;
+			}
+			for(BasicBlock *BB : lit->getBlocks()) {
+				for (BasicBlock::iterator itr = BB->begin(), e = BB->end(); itr != e; ++itr) {
+					if(!isa<StoreInst>(*itr) && !isa<LoadInst>(*itr)) {
+						continue;
+					}
+					StringRef alloc;
+					StringRef func = F.getName();
+					char type[16];
+					bool isIndirect;
+					bool isConstant;
+					const struct addrClosure *closure = reverseClosure(*itr, alloc, type, isIndirect, isConstant);
+					if(!closure) {
+						continue;
+					}
+					Value *vl = cast<Value>(itr);
+					struct streamProp sProp;
+					sProp.s_size = 1;
+					sProp.owner = false;
+					if(isIndirect == false && isConstant == false) {
+						//size of the loaded or stored value for byte and line streams
+						Type *elemTy = isa<LoadInst>(*itr) ? itr->getType() : cast<StoreInst>(*itr).getValueOperand()->getType();
+						int elemSize = F.getParent()->getDataLayout().getTypeAllocSize(elemTy);
+						deriveStream(loopDataV, alloc, func, type, elemSize, SE, *closure, sProp);
+						sProp.access = nestAccess++;
+					}
+					else if(isIndirect == true) {
+						streamLog() << "Indirect access " << alloc << " of type " << type << "; cannot enumrate stream addresses\n";
+					}
+					else if(isConstant == true) {
+						streamLog() << "Constant address access " << alloc << " of type " << type << "\n";
+					}
+					sProp.isIndirect = isIndirect;
+					sProp.isConstant = isConstant;
+					sProp.array = alloc.str();
+					sProp.isStore = isa<StoreInst>(*itr);
+					sProp.order = nest.accesses.size();
+					sProp.inst = &*itr;
+					sProp.nest = nest.index;
+					sProp.prelude = log.take();
+					propMap[vl] = sProp.order;
+					nest.accesses.push_back(std::move(sProp));
+				}
+			}
+		}
+	  }
+
+	  //analyzes the snapshotted functions on the pool, each distinct stream once
+	  void analyzeSnapshots(std::vector<struct funcSnap> &funcs) {
+		//the first access of a signature in module order analyzes it, as serially
+		std::vector<struct streamProp*> owners;
+		std::unordered_map<std::string, struct streamProp*> firstOf;
+		for(struct funcSnap &snap : funcs) {
+			for(struct nestSnap &nest : snap.nests) {
+				for(struct streamProp &acc : nest.accesses) {
+					if(acc.isIndirect || acc.isConstant) {
+						continue;
+					}
+					if(!StreamDumpDir.empty()) {
+						//several accesses share a stream name, so number the files
+						std::string fname = acc.sInfo.name;
+						fname = fname.substr(0, fname.size() - strlen(".stream"));
+						acc.dumpPath = StreamDumpDir + "/" + fname + "_" + std::to_string(dumpCount++) + ".stream";
+					}
+					if(StreamMemo) {
+						acc.sig = acc.sInfo.desc.signature();
+						if(memoMap.find(acc.sig) != memoMap.end() || !firstOf.insert(std::make_pair(acc.sig, &acc)).second) {
+							memoHits++;
+							continue;
 						}
+						memoMisses++;
 					}
-					
+					acc.owner = true;
+					owners.push_back(&acc);
 				}
-                	}
+			}
+		}
 
-			
-			string name = F.getName().str();
-			name = name + std::to_string(LoopCounter);
+		StreamPool::get().parallelFor(owners.size(), 1, [this, &owners](long begin, long end) {
+			for(long i = begin; i < end; i++) {
+				streamLogTo log(owners[i]->report);
+				analyzeStream(*owners[i]);
+			}
+		});
+		if(StreamMemo) {
+			for(struct streamProp *acc : owners) {
+				struct streamMemo memo;
+				memo.name = acc->sInfo.name;
+				memo.s_size = acc->s_size;
+				memo.dma = acc->dma;
+				memo.reused = acc->reused;
+				if(acc->reused && !StreamMRC.empty()) {
+					memo.reuseHist = acc->reuseHist;
+					memo.reuseDistinct = acc->reuseDistinct;
+				}
+				memoMap[acc->sig] = memo;
+			}
+		}
+
+		//the memo is complete, so the rest of every function runs on its own
+		StreamPool::get().parallelFor(funcs.size(), 1, [this, &funcs](long begin, long end) {
+			for(long i = begin; i < end; i++) {
+				finishFunction(funcs[i]);
+			}
+		});
+	  }
+
+	  //repeated streams, then what needs every access of a nest or of the function
+	  void finishFunction(struct funcSnap &snap) {
+		std::vector<std::vector<struct simAccess>> funcNests;
+		for(struct nestSnap &nest : snap.nests) {
+			std::vector<struct simAccess> nestSim;
+			for(struct streamProp &acc : nest.accesses) {
+				if(acc.isIndirect || acc.isConstant) {
+					continue;
+				}
+				if(!acc.owner) {
+					streamLogTo log(acc.report);
+					reuseMemo(acc);
+				}
+				if(needSimDesc()) {
+					struct simAccess sim;
+					sim.name = acc.sInfo.name;
+					sim.array = acc.array;
+					sim.elemSize = acc.elemSize;
+					sim.store = acc.isStore;
+					sim.desc = acc.simDesc;
+					assert(sim.desc.size() == acc.sInfo.desc.size() && "byte stream of the access was not derived");
+					sim.base = 0;
+					nestSim.push_back(sim);
+				}
+			}
+
+			streamLogTo log(nest.tail);
+			analyzeDeps(nest);
+			if(StreamCache && !nestSim.empty()) {
+				simulateCache(snap.name, nest.index, nestSim);
+			}
+			if(StreamFusion) {
+				funcNests.push_back(nestSim);
+			}
+			if(!StreamMRC.empty() && !nestSim.empty()) {
+				reportNestCurve(snap.name, nest.index, nestSim);
+			}
+			streamLog() << "Loop " << nest.index << " analyzed\n";
+		}
+
+		streamLogTo log(snap.foot);
+		streamLog() << "Loop count in function " << snap.name << " is : " << snap.nests.size() << "\n";
+		if(StreamFusion && funcNests.size() > 1) {
+			adviseFusion(snap.name, funcNests);
+		}
+	  }
+
+	  //prints the report of a function and its DMA descriptors, with the IR still in place for the graph
+	  void printSnapshot(struct funcSnap &snap) {
+		errs() << snap.head;
+		for(struct nestSnap &nest : snap.nests) {
+			genGraph graphVal;
+			map<Value*, int> strideMap;
+			for(struct streamProp &acc : nest.accesses) {
+				errs() << acc.prelude << acc.report;
+				if(dmaOut && !acc.dmaLine.empty()) {
+					*dmaOut << acc.dmaLine;
+				}
+				strideMap[acc.inst] = acc.s_size;
+				//graphVal.addToGraph(acc.inst, acc.array, acc.isStore ? "store" : "load");
+			}
+			std::string name = snap.name + std::to_string(nest.index);
 			graphVal.printGraph(name, strideMap);
 			graphVal.compStats();
 			//graphVal.loadPaths();
-			analyzeDeps();
-			errs() << "Loop " << LoopCounter << " analyzed\n";
+			errs() << nest.tail;
+		}
+		errs() << snap.foot;
+		//StreamAnalysis has no end of module to close the file at
+		if(dmaOut) {
+			dmaOut->flush();
 		}
+	  }
 
+	  void openOutputs() {
+		if(!StreamDMAFile.empty()) {
+			std::error_code EC;
+			dmaOut.reset(new raw_fd_ostream(StreamDMAFile, EC, sys::fs::OF_Text));
+			if(EC) {
+				errs() << "Cannot open " << StreamDMAFile << ": " << EC.message() << "\n";
+				exit(1);
+			}
+		}
+	  }
 
-    		errs() << "Loop count in function " << F.getName() << " is : " << LoopCounter << "\n";
-		
+	  bool doInitialization(Module &) override {
+		openOutputs();
+		return false;
+	  }
+
+	  void reportTotals(StringRef module) {
+		dmaOut.reset();
+		if(StreamMemo) {
+			errs() << "Stream memoization in module " << module << ": " << memoHits << " hits, " << memoMisses << " misses, " << memoMap.size() << " distinct streams\n";
+		}
+		if(StreamStrideCheck) {
+			errs() << "Stride self-check in module " << module << ": " << strideChecks.load() << " closed form streams checked, " << strideMismatches.load() << " differ from enumeration\n";
+		}
+	  }
+
+	  //snapshots every function of the module, analyzes them together and prints them in order
+	  template<typename GetLoops, typename GetSE> void analyzeModule(Module &M, GetLoops getLoops, GetSE getSE) {
+		std::vector<struct funcSnap> funcs;
+		for(Function &F : M) {
+			if(F.isDeclaration()) {
+				continue;
+			}
+			funcs.push_back(funcSnap());
+			snapshotFunction(F, getLoops(F), getSE(F), funcs.back());
+		}
+		analyzeSnapshots(funcs);
+		for(struct funcSnap &snap : funcs) {
+			printSnapshot(snap);
+		}
+	  }
+
+	  bool doFinalization(Module &M) override {
+		reportTotals(M.getName());
+		return false;
+	  }
+  };
+
+  // stat1loop over a whole module at once, so the functions are analyzed
+  // concurrently on the stream pool instead of one after the other
+  struct Stat1Module : public ModulePass {
+	  static char ID;
+	  Stat1Loop engine;
+	  Stat1Module() : ModulePass(ID) {}
+
+	  virtual void getAnalysisUsage(AnalysisUsage& AU) const override {
+		AU.addRequired<LoopInfoWrapperPass>();
+		AU.addRequired<ScalarEvolutionWrapperPass>();
+		AU.setPreservesAll();
+	  }
+
+	  bool runOnModule(Module &M) override {
+		engine.openOutputs();
+		engine.analyzeModule(M, [this](Function &F) -> LoopInfo& {
+			return getAnalysis<LoopInfoWrapperPass>(F).getLoopInfo();
+		}, [this](Function &F) -> ScalarEvolution& {
+			return getAnalysis<ScalarEvolutionWrapperPass>(F).getSE();
+		});
+		engine.reportTotals(M.getName());
 		return false;
 	  }
   };
@@ -850,3 +1259,92 @@ namespace {
 
 char Stat1Loop::ID = 0;
 static RegisterPass<Stat1Loop> Y("stat1loop", "Static analysis 1 in loop pass");
+char Stat1Module::ID = 0;
+static RegisterPass<Stat1Module> Z("stat1module", "Static analysis 1 over all functions of a module in parallel");
+
+// One engine for every function the new pass manager analyzes, so the
+// memoized streams and the DMA file span the whole module like under the
+// legacy pass. It stays for the rest of the process; the DMA file is
+// flushed as lines are written.
+static Stat1Loop &streamEngine() {
+	static Stat1Loop *engine = nullptr;
+	if(!engine) {
+		engine = new Stat1Loop();
+		engine->openOutputs();
+	}
+	return *engine;
+}
+
+void writeStreamDMA(StreamAnalysis::Result &res) {
+	Stat1Loop &engine = streamEngine();
+	if(engine.dmaOut && !res.dma.empty()) {
+		*engine.dmaOut << res.dma;
+		engine.dmaOut->flush();
+	}
+	res.dma.clear();
+}
+
+void printStreamTotals(StringRef module) {
+	streamEngine().reportTotals(module);
+}
+
+AnalysisKey StreamAnalysis::Key;
+
+namespace {
+  // New pass manager form of stat1module
+  struct Stat1ModulePass : public PassInfoMixin<Stat1ModulePass> {
+	  PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM) {
+		FunctionAnalysisManager &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+		Stat1Loop &engine = streamEngine();
+		engine.analyzeModule(M, [&FAM](Function &F) -> LoopInfo& {
+			return FAM.getResult<LoopAnalysis>(F);
+		}, [&FAM](Function &F) -> ScalarEvolution& {
+			return FAM.getResult<ScalarEvolutionAnalysis>(F);
+		});
+		engine.reportTotals(M.getName());
+		return PreservedAnalyses::all();
+	  }
+  };
+}
+
+StreamAnalysis::Result StreamAnalysis::run(Function &F, FunctionAnalysisManager &FAM) {
+	Result res;
+	Stat1Loop &engine = streamEngine();
+	engine.result = &res;
+	engine.analyzeFunction(F, FAM.getResult<LoopAnalysis>(F), FAM.getResult<ScalarEvolutionAnalysis>(F));
+	engine.result = nullptr;
+	res.finish();
+	return res;
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK PassPluginLibraryInfo llvmGetPassPluginInfo() {
+	return {LLVM_PLUGIN_API_VERSION, "StreamAnalysis", LLVM_VERSION_STRING, [](PassBuilder &PB) {
+		PB.registerAnalysisRegistrationCallback([](FunctionAnalysisManager &FAM) {
+			FAM.registerPass([] { return StreamAnalysis(); });
+		});
+		PB.registerPipelineParsingCallback([](StringRef Name, FunctionPassManager &FPM, ArrayRef<PassBuilder::PipelineElement>) {
+			if(Name == "print<streams>") {
+				FPM.addPass(StreamPrinterPass(errs()));
+				return true;
+			}
+			return false;
+		});
+		PB.registerPipelineParsingCallback([](StringRef Name, ModulePassManager &MPM, ArrayRef<PassBuilder::PipelineElement>) {
+			if(Name == "stat1module") {
+				MPM.addPass(Stat1ModulePass());
+				return true;
+			}
+			if(Name == "print<streams>") {
+				MPM.addPass(StreamModulePrinterPass(errs()));
+				return true;
+			}
+			return false;
+		});
+		//inside clang or an LTO link the streams are printed once the function is optimized
+		PB.registerOptimizerLastEPCallback([](ModulePassManager &MPM, OptimizationLevel) {
+			if(StreamPrintLate) {
+				MPM.addPass(StreamModulePrinterPass(errs()));
+			}
+		});
+	}};
+}
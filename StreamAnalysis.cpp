@@ -0,0 +1,70 @@
+#include "StreamAnalysis.h"
+#include "StreamDeps.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include <climits>
+
+void StreamAnalysis::Result::finish() {
+	index.clear();
+	for(unsigned l = 0; l < loops.size(); l++) {
+		for(unsigned a = 0; a < loops[l].accesses.size(); a++) {
+			index[loops[l].accesses[a].inst] = make_pair(l, a);
+		}
+	}
+}
+
+const struct accessStream *StreamAnalysis::Result::lookup(const Instruction *inst) const {
+	auto found = index.find(inst);
+	if(found == index.end()) {
+		return nullptr;
+	}
+	return &loops[found->second.first].accesses[found->second.second];
+}
+
+bool StreamAnalysis::Result::invalidate(Function &, const PreservedAnalyses &PA, FunctionAnalysisManager::Invalidator &) {
+	//loops and instructions are held by pointer, so any change the pass does
+	//not declare harmless drops them, even if it keeps LoopInfo up to date
+	auto PAC = PA.getChecker<StreamAnalysis>();
+	return !(PAC.preserved() || PAC.preservedSet<AllAnalysesOn<Function>>());
+}
+
+PreservedAnalyses StreamPrinterPass::run(Function &F, FunctionAnalysisManager &FAM) {
+	StreamAnalysis::Result &res = FAM.getResult<StreamAnalysis>(F);
+	OS << res.report;
+	writeStreamDMA(res);
+	OS << "Streams of " << F.getName() << " : " << res.loops.size() << " loop nests\n";
+	for(unsigned l = 0; l < res.loops.size(); l++) {
+		const struct loopStreams &streams = res.loops[l];
+		OS << "Loop nest " << l + 1 << " at " << streams.loop->getHeader()->getName() << " : " << streams.accesses.size() << " accesses\n";
+		for(const struct accessStream &acc : streams.accesses) {
+			OS << "  " << (acc.isStore ? "store" : "load") << " of " << acc.array;
+			if(acc.isIndirect) {
+				OS << " indirect\n";
+			}
+			else if(acc.isConstant) {
+				OS << " constant address\n";
+			}
+			else if(acc.desc.size() == 0) {
+				OS << " " << acc.name << " : no addresses\n";
+			}
+			else {
+				//the ends of a stream need not be its extremes
+				long lo = LONG_MAX, hi = LONG_MIN;
+				streamRange(acc.desc, lo, hi);
+				OS << " " << acc.name << " : " << acc.desc.size() << " addresses from " << lo << " to " << hi << ", smallest continuous substream " << acc.s_size << "\n";
+			}
+		}
+	}
+	return PreservedAnalyses::all();
+}
+
+PreservedAnalyses StreamModulePrinterPass::run(Module &M, ModuleAnalysisManager &MAM) {
+	FunctionAnalysisManager &FAM = MAM.getResult<FunctionAnalysisManagerModuleProxy>(M).getManager();
+	StreamPrinterPass printer(OS);
+	for(Function &F : M) {
+		if(!F.isDeclaration()) {
+			printer.run(F, FAM);
+		}
+	}
+	printStreamTotals(M.getName());
+	return PreservedAnalyses::all();
+}
@@ -0,0 +1,87 @@
+#ifndef _STREAMANALYSIS_H_
+#define _STREAMANALYSIS_H_
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Instruction.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Support/raw_ostream.h"
+#include "StreamDesc.h"
+#include <string>
+#include <vector>
+using namespace llvm;
+using namespace std;
+
+// Stream of one load or store of a loop nest. Indirect and constant
+// address accesses carry no name or descriptor.
+struct accessStream {
+	Instruction *inst;
+	std::string name;
+	std::string array;
+	bool isStore;
+	bool isIndirect;
+	bool isConstant;
+	StreamDescriptor desc;
+	int s_size;
+};
+
+// Accesses of one top level loop nest in the order of the loop body
+struct loopStreams {
+	Loop *loop;
+	vector<struct accessStream> accesses;
+};
+
+// New pass manager analysis computing the streams of every loop nest of a
+// function with the stat1loop engine, so the options of that pass apply.
+// The report of the engine is kept in the result for print<streams>. The result stays
+// cached until a pass that does not preserve StreamAnalysis changes the
+// function.
+class StreamAnalysis : public AnalysisInfoMixin<StreamAnalysis> {
+	friend AnalysisInfoMixin<StreamAnalysis>;
+	static AnalysisKey Key;
+
+	public:
+	class Result {
+		DenseMap<const Instruction*, pair<unsigned, unsigned>> index;
+
+		public:
+		vector<struct loopStreams> loops;
+		// what stat1loop prints for the function, and its DMA lines until written
+		std::string report;
+		std::string dma;
+		// indexes the accesses of loops once they are filled in
+		void finish();
+		// stream of a load or store, nullptr if it is in no loop nest
+		const struct accessStream *lookup(const Instruction *inst) const;
+		bool invalidate(Function &F, const PreservedAnalyses &PA, FunctionAnalysisManager::Invalidator &Inv);
+	};
+
+	Result run(Function &F, FunctionAnalysisManager &FAM);
+};
+
+// Prints the streams StreamAnalysis holds for a function, -passes=print<streams>
+class StreamPrinterPass : public PassInfoMixin<StreamPrinterPass> {
+	raw_ostream &OS;
+
+	public:
+	explicit StreamPrinterPass(raw_ostream &OS) : OS(OS) {}
+	PreservedAnalyses run(Function &F, FunctionAnalysisManager &FAM);
+};
+
+// Prints the streams of every function of a module, then the memoization
+// and stride check totals of the module; print<streams> in a module
+// pipeline and -stream-print-late
+class StreamModulePrinterPass : public PassInfoMixin<StreamModulePrinterPass> {
+	raw_ostream &OS;
+
+	public:
+	explicit StreamModulePrinterPass(raw_ostream &OS) : OS(OS) {}
+	PreservedAnalyses run(Module &M, ModuleAnalysisManager &MAM);
+};
+
+// Defined with the engine: appends the DMA lines of res to -stream-dma-file
+// once, and prints the totals of the engine for module
+void writeStreamDMA(StreamAnalysis::Result &res);
+void printStreamTotals(StringRef module);
+
+#endif
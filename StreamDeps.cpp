@@ -0,0 +1,108 @@
+#include "StreamDeps.h"
+#include <algorithm>
+#include <climits>
+
+addrTable::addrTable(long lo, long hi, long expected) : lo(lo) {
+	//a flat table pays off while most of its entries can be used
+	isDense = hi - lo + 1 <= std::max(4 * expected, 1L << 16);
+	if(isDense) {
+		dense.assign(hi - lo + 1, -1);
+	}
+}
+
+void streamRange(const StreamDescriptor &desc, long &lo, long &hi) {
+	struct streamCursor cur = desc.cursorAt(0);
+	long buf[STREAM_BLOCK];
+	for(long pos = 0; pos < desc.size(); pos += STREAM_BLOCK) {
+		long n = desc.size() - pos < STREAM_BLOCK ? desc.size() - pos : STREAM_BLOCK;
+		desc.fill(cur, buf, n);
+		for(long i = 0; i < n; i++) {
+			lo = std::min(lo, buf[i]);
+			hi = std::max(hi, buf[i]);
+		}
+	}
+}
+
+void streamDeps(const StreamDescriptor &store, const vector<const StreamDescriptor*> &others, const vector<bool> &before, vector<struct streamDep> &deps) {
+	struct streamDep none = {0, 0, LONG_MAX, LONG_MIN};
+	deps.assign(others.size(), none);
+	if(store.size() == 0) {
+		return;
+	}
+	long lo = LONG_MAX, hi = LONG_MIN;
+	streamRange(store, lo, hi);
+	long total = store.size();
+	for(const StreamDescriptor *desc : others) {
+		total = std::max(total, desc->size());
+	}
+
+	//accesses of an address outside the store's interval cannot depend on it
+	addrTable lastWrite(lo, hi, store.size());
+	vector<struct streamCursor> curs;
+	for(const StreamDescriptor *desc : others) {
+		curs.push_back(desc->size() > 0 ? desc->cursorAt(0) : streamCursor());
+	}
+	struct streamCursor storeCur = store.cursorAt(0);
+	vector<long> storeBuf(STREAM_BLOCK);
+	vector<long> bufs(others.size() * STREAM_BLOCK);
+	for(long pos = 0; pos < total; pos += STREAM_BLOCK) {
+		long cnt = total - pos < STREAM_BLOCK ? total - pos : STREAM_BLOCK;
+		long storeCnt = std::max(0L, std::min(cnt, store.size() - pos));
+		if(storeCnt > 0) {
+			store.fill(storeCur, storeBuf.data(), storeCnt);
+		}
+		for(unsigned k = 0; k < others.size(); k++) {
+			long m = std::min(cnt, others[k]->size() - pos);
+			if(m > 0) {
+				others[k]->fill(curs[k], &bufs[k * STREAM_BLOCK], m);
+			}
+		}
+		for(long i = 0; i < cnt; i++) {
+			//accesses before the store in the body read the older value
+			for(int phase = 0; phase < 2; phase++) {
+				if(phase == 1 && i < storeCnt) {
+					lastWrite.set(storeBuf[i], pos + i);
+				}
+				for(unsigned k = 0; k < others.size(); k++) {
+					if(before[k] != (phase == 0) || pos + i >= others[k]->size()) {
+						continue;
+					}
+					long addr = bufs[k * STREAM_BLOCK + i];
+					if(addr < lo || addr > hi) {
+						continue;
+					}
+					long written = lastWrite.get(addr);
+					if(written >= 0) {
+						struct streamDep &dep = deps[k];
+						long dist = pos + i - written;
+						dep.flows++;
+						dep.minDist = std::min(dep.minDist, dist);
+						dep.maxDist = std::max(dep.maxDist, dist);
+					}
+				}
+			}
+		}
+	}
+
+	//lastWrite now holds every address the store writes
+	for(unsigned k = 0; k < others.size(); k++) {
+		const StreamDescriptor &desc = *others[k];
+		addrTable seen(lo, hi, desc.size());
+		struct streamCursor cur = desc.size() > 0 ? desc.cursorAt(0) : streamCursor();
+		long buf[STREAM_BLOCK];
+		for(long pos = 0; pos < desc.size(); pos += STREAM_BLOCK) {
+			long n = desc.size() - pos < STREAM_BLOCK ? desc.size() - pos : STREAM_BLOCK;
+			desc.fill(cur, buf, n);
+			for(long i = 0; i < n; i++) {
+				long addr = buf[i];
+				if(addr < lo || addr > hi || seen.get(addr) >= 0) {
+					continue;
+				}
+				seen.set(addr, 1);
+				if(lastWrite.get(addr) >= 0) {
+					deps[k].overlap++;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef _STREAMDEPS_H_
+#define _STREAMDEPS_H_
+
+#include "StreamDesc.h"
+#include "FlatHist.h"
+#include <vector>
+using namespace std;
+
+// Value per address of an interval, -1 where unset: a flat vector over
+// [lo, hi] when that is not much larger than the addresses expected in it,
+// otherwise a hash table of the addresses set.
+class addrTable {
+	long lo;
+	vector<long> dense;
+	flatHist sparse;
+	bool isDense;
+
+	public:
+	addrTable(long lo, long hi, long expected);
+	long get(long addr) const {
+		if(isDense) {
+			return dense[addr - lo];
+		}
+		return sparse.get(addr) - 1;
+	}
+	void set(long addr, long val) {
+		if(isDense) {
+			dense[addr - lo] = val;
+		}
+		else {
+			sparse.at(addr) = val + 1;
+		}
+	}
+};
+
+// Dependence of one access on a store to the same array in a loop nest.
+// overlap counts the distinct addresses both touch; flows counts the
+// accesses that find a value the store wrote earlier in the nest, with the
+// iterations between the write and the access from minDist to maxDist.
+struct streamDep {
+	long overlap;
+	long flows;
+	long minDist;
+	long maxDist;
+};
+
+// smallest and largest address of a stream, from one pass over it
+void streamRange(const StreamDescriptor &desc, long &lo, long &hi);
+
+// Dependences of every access of others on store. All streams run over the
+// iteration space of the same nest, so a stream position is an iteration;
+// before[i] tells whether others[i] comes before the store in the loop
+// body and so misses a value written in its own iteration. One sweep over
+// the iterations in blocks records the last write of every address, a
+// second one per access finds the distinct addresses it shares with the
+// store. Addresses are indexed over the interval the streams span.
+void streamDeps(const StreamDescriptor &store, const vector<const StreamDescriptor*> &others, const vector<bool> &before, vector<struct streamDep> &deps);
+
+#endif
@@ -0,0 +1,358 @@
+#include "llvm/Support/raw_ostream.h"
+#include "StreamDesc.h"
+#include "StreamPool.h"
+#include "DervInd.h"
+#include <algorithm>
+#include <climits>
+
+//index of the loop outside loop upto whose induction variable is ind, or -1
+static int outerLoop(vector<struct LoopData> &allLoopData, unsigned upto, Value *ind) {
+	if(!ind) {
+		return -1;
+	}
+	for(unsigned j = 0; j < upto; j++) {
+		if(allLoopData[j].indVar == ind) {
+			return j;
+		}
+	}
+	return -1;
+}
+
+static long tripCount(long start, long end, long step) {
+	if(step > 0 && end > start) {
+		return (end - start + step - 1) / step;
+	}
+	if(step < 0 && start > end) {
+		return (start - end - step - 1) / -step;
+	}
+	return 0;
+}
+
+//iv holds the induction values of the loops the bounds refer to
+static long tripCount(const struct nestBound &bnd, const int *iv) {
+	long start = bnd.initV + (bnd.initLoop < 0 ? 0 : iv[bnd.initLoop]);
+	long end = bnd.finalLoop < 0 ? bnd.finalV : iv[bnd.finalLoop];
+	return tripCount(start, end, bnd.stepV);
+}
+
+static int loopStart(const struct nestBound &bnd, const int *iv) {
+	return bnd.initV + (bnd.initLoop < 0 ? 0 : iv[bnd.initLoop]);
+}
+
+//lists the outer iterations of the nest that run the innermost loop
+static void walkOuter(const vector<struct nestBound> &bounds, unsigned l, vector<int> &iv, struct outerSpace &sp, long &total) {
+	const struct nestBound &bnd = bounds[l];
+	long trip = tripCount(bnd, iv.data());
+	int start = loopStart(bnd, iv.data());
+	for(long k = 0; k < trip; k++) {
+		iv[l] = start + bnd.stepV * k;
+		if(l + 2 < bounds.size()) {
+			walkOuter(bounds, l + 1, iv, sp, total);
+			continue;
+		}
+		long inner = tripCount(bounds.back(), iv.data());
+		if(inner > 0) {
+			sp.rank.push_back(total);
+			sp.vals.insert(sp.vals.end(), iv.begin(), iv.begin() + sp.width);
+			total += inner;
+		}
+	}
+}
+
+StreamDescriptor::StreamDescriptor(vector<struct LoopData> &allLoopData, vector<struct LoopData*> &compLoopV, int elemSize, unsigned lineBytes) : total(0), unitV(elemSize), lineShift(0) {
+	chains.base = 0;
+	while(lineBytes > 1) {
+		lineBytes >>= 1;
+		lineShift++;
+	}
+	if(lineShift > 0) {
+		unitV = 1;
+	}
+	bool rect = true;
+	for(unsigned l = 0; l < allLoopData.size(); l++) {
+		struct LoopData &ldata = allLoopData[l];
+		struct nestBound bnd;
+		bnd.initV = ldata.initV;
+		bnd.stepV = ldata.stepV;
+		bnd.finalV = ldata.finalV;
+		bnd.initLoop = ldata.initCons ? -1 : outerLoop(allLoopData, l, ldata.initInd);
+		bnd.finalLoop = ldata.finalCons ? -1 : outerLoop(allLoopData, l, ldata.finalInd);
+		if(!ldata.initCons && bnd.initLoop < 0) {
+			//initialized from something other than an outer induction variable
+			bnd.initV = 0;
+		}
+		if(bnd.initLoop >= 0 || bnd.finalLoop >= 0) {
+			rect = false;
+		}
+		bounds.push_back(bnd);
+	}
+
+	long factor = 1;
+	vector<long> divV(bounds.size()), tripV(bounds.size());
+	for(int l = bounds.size() - 1; l >= 0; l--) {
+		divV[l] = factor;
+		if(rect) {
+			tripV[l] = tripCount(bounds[l], NULL);
+			factor = factor * tripV[l];
+		}
+	}
+	if(rect) {
+		total = bounds.empty() ? 0 : factor;
+	}
+	else {
+		std::shared_ptr<struct outerSpace> sp = std::make_shared<struct outerSpace>();
+		sp->width = bounds.size() - 1;
+		vector<int> iv(bounds.size(), 0);
+		walkOuter(bounds, 0, iv, *sp, total);
+		sp->rank.push_back(total);
+		space = sp;
+	}
+
+	for(struct LoopData *ldata : compLoopV) {
+		struct streamLevel lvl;
+		lvl.loop = ldata - &allLoopData[0];
+		lvl.divInd = divV[lvl.loop];
+		lvl.modInd = rect && tripV[lvl.loop] > 0 ? tripV[lvl.loop] : 1;
+		lvl.initV = bounds[lvl.loop].initV;
+		lvl.stepV = bounds[lvl.loop].stepV;
+		lvl.hidFact = ldata->hidFact * elemSize;
+		lvl.opsVV = ldata->opsVV;
+		lvl.factsVV = ldata->factsVV;
+		compileLevel(chains, levels.size(), lvl.hidFact, lvl.opsVV, lvl.factsVV);
+		levels.push_back(lvl);
+	}
+	chains.slope.resize(levels.size(), 0);
+}
+
+long StreamDescriptor::tripOf(unsigned l) const {
+	return tripCount(bounds[l], NULL);
+}
+
+int StreamDescriptor::innerStart(const int *vals) const {
+	return loopStart(bounds.back(), vals);
+}
+
+void StreamDescriptor::levelValues(long i, vector<int> &ind) const {
+	ind.clear();
+	if(!space) {
+		for(const struct streamLevel &ldata : levels) {
+			ind.push_back(ldata.initV + ldata.stepV * (int)((i / ldata.divInd) % ldata.modInd));
+		}
+		return;
+	}
+	struct streamCursor cur = cursorAt(i);
+	const int *vals = &space->vals[cur.tuple * space->width];
+	for(const struct streamLevel &ldata : levels) {
+		if(ldata.loop == space->width) {
+			ind.push_back(innerStart(vals) + ldata.stepV * (int)cur.off);
+		}
+		else {
+			ind.push_back(vals[ldata.loop]);
+		}
+	}
+}
+
+long StreamDescriptor::addrAt(long i) const {
+	long pos = chains.base;
+	vector<int> ind;
+	levelValues(i, ind);
+	for(unsigned lvl = 0; lvl < levels.size(); lvl++) {
+		pos = pos + chains.slope[lvl] * ind[lvl];
+	}
+	for(const struct chainEval &e : chains.terms) {
+		pos = pos + evalTerm(chains, e, ind[e.level]);
+	}
+	return pos >> lineShift;
+}
+
+std::string StreamDescriptor::signature() const {
+	std::string sig = std::to_string(total) + "," + std::to_string(unitV) + "," + std::to_string(lineShift);
+	if(space) {
+		//the iteration space is no longer implied by divInd/modInd
+		for(const struct nestBound &bnd : bounds) {
+			sig += "{" + std::to_string(bnd.initV) + "," + std::to_string(bnd.stepV) + "," + std::to_string(bnd.finalV) + "," + std::to_string(bnd.initLoop) + "," + std::to_string(bnd.finalLoop) + "}";
+		}
+	}
+	for(const struct streamLevel &ldata : levels) {
+		sig += "|" + std::to_string(ldata.divInd) + "," + std::to_string(ldata.modInd) + "," + std::to_string(ldata.initV) + "," + std::to_string(ldata.stepV) + "," + std::to_string(ldata.hidFact);
+		if(space) {
+			sig += "@" + std::to_string(ldata.loop);
+		}
+		//the chains of a level are summed, so their order does not matter;
+		//adding 0 and multiplying by 1 leave the value unchanged
+		vector<std::string> chainV;
+		for(unsigned i = 0; i < ldata.opsVV.size(); i++) {
+			std::string chain;
+			for(unsigned j = 0; j < ldata.opsVV[i].size(); j++) {
+				int op = ldata.opsVV[i][j];
+				int fact = ldata.factsVV[i][j];
+				if((op == Oprs::Add && fact == 0) || (op == Oprs::Mul && fact == 1)) {
+					continue;
+				}
+				chain += std::to_string(op) + ":" + std::to_string(fact) + " ";
+			}
+			chainV.push_back(chain);
+		}
+		std::sort(chainV.begin(), chainV.end());
+		for(std::string &chain : chainV) {
+			sig += "[" + chain + "]";
+		}
+	}
+	return sig;
+}
+
+struct streamCursor StreamDescriptor::cursorAt(long i) const {
+	struct streamCursor cur;
+	cur.pos = i;
+	cur.tuple = 0;
+	cur.off = 0;
+	cur.last = LONG_MIN;
+	if(space) {
+		//outer iteration holding position i
+		const vector<long> &rank = space->rank;
+		if(rank.size() > 1) {
+			cur.tuple = std::upper_bound(rank.begin(), rank.end() - 1, i) - rank.begin() - 1;
+			if(cur.tuple < 0) {
+				cur.tuple = 0;
+			}
+			cur.off = i - rank[cur.tuple];
+		}
+	}
+	else {
+		for(const struct streamLevel &ldata : levels) {
+			cur.rem.push_back(i % ldata.divInd);
+			cur.ind.push_back((i / ldata.divInd) % ldata.modInd);
+		}
+	}
+	cur.lanes.resize(levels.size() * STREAM_BLOCK);
+	return cur;
+}
+
+void StreamDescriptor::fillLanes(struct streamCursor &cur, long cnt) const {
+	for(unsigned lvl = 0; lvl < levels.size(); lvl++) {
+		const struct streamLevel &ldata = levels[lvl];
+		int *lane = &cur.lanes[lvl * STREAM_BLOCK];
+		long k = 0;
+		while(k < cnt) {
+			long run = ldata.divInd - cur.rem[lvl];
+			if(run > cnt - k) {
+				run = cnt - k;
+			}
+			std::fill(lane + k, lane + k + run, ldata.initV + ldata.stepV * cur.ind[lvl]);
+			k += run;
+			cur.rem[lvl] += run;
+			if(cur.rem[lvl] == ldata.divInd) {
+				cur.rem[lvl] = 0;
+				if(++cur.ind[lvl] == ldata.modInd) {
+					cur.ind[lvl] = 0;
+				}
+			}
+		}
+	}
+}
+
+void StreamDescriptor::fillBounded(struct streamCursor &cur, long cnt) const {
+	const struct nestBound &inner = bounds.back();
+	long k = 0;
+	while(k < cnt) {
+		const int *vals = &space->vals[cur.tuple * space->width];
+		long trip = space->rank[cur.tuple + 1] - space->rank[cur.tuple];
+		long run = trip - cur.off;
+		if(run > cnt - k) {
+			run = cnt - k;
+		}
+		int start = innerStart(vals) + inner.stepV * (int)cur.off;
+		for(unsigned lvl = 0; lvl < levels.size(); lvl++) {
+			int *lane = &cur.lanes[lvl * STREAM_BLOCK];
+			if(levels[lvl].loop == space->width) {
+				for(long j = 0; j < run; j++) {
+					lane[k + j] = start + inner.stepV * (int)j;
+				}
+			}
+			else {
+				std::fill(lane + k, lane + k + run, vals[levels[lvl].loop]);
+			}
+		}
+		k += run;
+		cur.off += run;
+		if(cur.off == trip) {
+			cur.tuple++;
+			cur.off = 0;
+		}
+	}
+}
+
+void StreamDescriptor::fill(struct streamCursor &cur, long *out, long n) const {
+	addrKernelFn kernel = getAddrKernel();
+	for(long done = 0; done < n; done += STREAM_BLOCK) {
+		long cnt = n - done < STREAM_BLOCK ? n - done : STREAM_BLOCK;
+		if(space) {
+			fillBounded(cur, cnt);
+		}
+		else {
+			fillLanes(cur, cnt);
+		}
+		kernel(chains, cur.lanes.data(), STREAM_BLOCK, out + done, cnt);
+		if(lineShift > 0) {
+			for(long k = 0; k < cnt; k++) {
+				out[done + k] >>= lineShift;
+			}
+		}
+	}
+	cur.pos += n;
+}
+
+long StreamDescriptor::fillCollapsed(struct streamCursor &cur, long *out, long n) const {
+	fill(cur, out, n);
+	if(lineShift == 0 || n == 0) {
+		return n;
+	}
+	long cnt = std::unique(out, out + n) - out;
+	//the line the previous block ended on may carry over into this one
+	if(out[0] == cur.last) {
+		std::copy(out + 1, out + cnt, out);
+		cnt--;
+	}
+	if(cnt > 0) {
+		cur.last = out[cnt - 1];
+	}
+	return cnt;
+}
+
+void StreamDescriptor::fill(long start, long *out, long n) const {
+	struct streamCursor cur = cursorAt(start);
+	fill(cur, out, n);
+}
+
+std::unique_ptr<long[]> StreamDescriptor::materialize() const {
+	// left uninitialized, the first touch happens in the workers
+	std::unique_ptr<long[]> addrs(new long[total]);
+	long *out = addrs.get();
+	StreamPool::get().parallelFor(total, STREAM_GRAIN, [this, out](long begin, long end) {
+		struct streamCursor cur = cursorAt(begin);
+		fill(cur, out + begin, end - begin);
+	});
+	return addrs;
+}
+
+std::unique_ptr<long[]> StreamDescriptor::materialize(long &n) const {
+	std::unique_ptr<long[]> addrs = materialize();
+	n = total;
+	if(lineShift > 0) {
+		n = std::unique(addrs.get(), addrs.get() + total) - addrs.get();
+	}
+	return addrs;
+}
+
+StreamDescriptor::iterator::iterator(const StreamDescriptor *desc, long pos) : desc(desc), pos(pos), bufStart(pos) {
+	if(pos < desc->total) {
+		cur = desc->cursorAt(pos);
+		refill();
+	}
+}
+
+void StreamDescriptor::iterator::refill() {
+	long n = desc->total - pos < STREAM_BLOCK ? desc->total - pos : STREAM_BLOCK;
+	bufStart = pos;
+	desc->fill(cur, buf, n);
+}
@@ -0,0 +1,190 @@
+#ifndef _STREAMDESC_H_
+#define _STREAMDESC_H_
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Instructions.h"
+#include "AddrKernel.h"
+#include <memory>
+#include <string>
+#include <vector>
+using namespace llvm;
+using namespace std;
+
+struct LoopData {
+	Loop *lp;
+	int initV;
+	int stepV;
+	int finalV;
+
+	//the outer induction variables the bounds start or end at, unless constant
+	bool initCons;
+	Value *initInd;
+	bool finalCons;
+	Value *finalInd;
+
+	PHINode *indVar;
+
+	long scaleV;
+	int constV;
+	vector<int> scaleVV;
+	vector<int> constVV;
+	vector<int> modVV;
+	vector<vector<int>> opsVV;
+	vector<vector<int>> factsVV;
+	long hidFact;
+
+	long modInd;
+	long divInd;
+};
+
+// One loop level of a stream kept in symbolic form. In a rectangular nest
+// the iteration counter of the level for stream position c is
+// (c / divInd) % modInd and its induction value is initV + stepV * counter;
+// each op chain of opsVV/factsVV is applied to the induction value and the
+// sum of the chains is scaled by hidFact. loop is the level's index in the nest.
+struct streamLevel {
+	unsigned loop;
+	long divInd;
+	long modInd;
+	int initV;
+	int stepV;
+	long hidFact;
+	vector<vector<int>> opsVV;
+	vector<vector<int>> factsVV;
+};
+
+// Bounds of one loop of the nest: the induction value runs from initV (plus
+// the induction value of loop initLoop) up to finalV (or the induction value
+// of loop finalLoop) with stepV. initLoop/finalLoop are -1 for constants.
+struct nestBound {
+	int initV;
+	int stepV;
+	int finalV;
+	int initLoop;
+	int finalLoop;
+};
+
+// Iteration space of the outer loops of a nest with bounds depending on
+// outer induction variables. Only the outer iterations that run the
+// innermost loop at least once are listed, with the stream position they
+// start at; rank has one more entry holding the total.
+struct outerSpace {
+	unsigned width;
+	vector<long> rank;
+	vector<int> vals;
+};
+
+// Addresses generated per call of the address kernel
+#define STREAM_BLOCK 256
+// Addresses per task when a stream is enumerated on the pool
+#define STREAM_GRAIN (1 << 16)
+
+// Position inside a stream with the running counter and iteration of every
+// level, or the outer iteration and innermost offset for non-rectangular
+// nests, plus the lane buffer the kernel reads the induction values from.
+struct streamCursor {
+	long pos;
+	vector<long> rem;
+	vector<int> ind;
+	long tuple;
+	long off;
+	long last;
+	vector<int> lanes;
+};
+
+// Address stream of a load/store described by the op chains of the loops
+// that compute its address. Addresses are generated on demand, either by
+// random access through addrAt(), in blocks through fill() or sequentially
+// through an iterator, so the stream is never materialized.
+//
+// Triangular, trapezoidal and offset nests are walked over their valid
+// iteration space only: the outer iterations are listed once up front and
+// the innermost loop is generated in runs, so the size is the exact count.
+class StreamDescriptor {
+	vector<struct streamLevel> levels;
+	vector<struct nestBound> bounds;
+	std::shared_ptr<const struct outerSpace> space;
+	struct compiledChains chains;
+	long total;
+	long unitV;
+	int lineShift;
+
+	int innerStart(const int *vals) const;
+	void levelValues(long i, vector<int> &ind) const;
+	void fillLanes(struct streamCursor &cur, long cnt) const;
+	void fillBounded(struct streamCursor &cur, long cnt) const;
+
+	public:
+	StreamDescriptor() : total(0), unitV(1), lineShift(0) { chains.base = 0; }
+	// compLoopV points into allLoopData, the loops of the nest outermost first.
+	// Addresses are element indices by default; an elemSize in bytes turns
+	// them into byte addresses and a power of two lineBytes into cache line
+	// numbers.
+	StreamDescriptor(vector<struct LoopData> &allLoopData, vector<struct LoopData*> &compLoopV, int elemSize = 1, unsigned lineBytes = 0);
+
+	// number of accesses, before same-line accesses are collapsed
+	long size() const { return total; }
+	bool rectangular() const { return !space; }
+	bool lineMode() const { return lineShift > 0; }
+	// address difference of two contiguous accesses
+	long unit() const { return unitV; }
+	const vector<struct streamLevel> &getLevels() const { return levels; }
+	const vector<struct nestBound> &getBounds() const { return bounds; }
+	// trip count of loop l of a rectangular nest
+	long tripOf(unsigned l) const;
+	const struct compiledChains &compiled() const { return chains; }
+	long addrAt(long i) const;
+	// first and last address, 0 for a stream without accesses
+	long front() const { return total > 0 ? addrAt(0) : 0; }
+	long back() const { return total > 0 ? addrAt(total - 1) : 0; }
+	// Canonical form of the bounds and op chains: two descriptors with the
+	// same signature generate the same stream whatever access they came from
+	std::string signature() const;
+
+	// Block generation with incremental counters instead of a division and
+	// modulo per level and address; the op chains run in the SIMD kernel.
+	struct streamCursor cursorAt(long i) const;
+	void fill(struct streamCursor &cur, long *out, long n) const;
+	void fill(long start, long *out, long n) const;
+	// Like fill, but in line mode an access to the same line as the one
+	// before it is dropped; returns the number of addresses written
+	long fillCollapsed(struct streamCursor &cur, long *out, long n) const;
+
+	// Enumerates the whole stream on the pool into one buffer allocated
+	// up front; every task writes its own slice, so nothing is merged or
+	// copied afterwards. Only for consumers that revisit addresses. In line
+	// mode same-line accesses are then collapsed in place and n is set to
+	// the collapsed length.
+	std::unique_ptr<long[]> materialize() const;
+	std::unique_ptr<long[]> materialize(long &n) const;
+
+	class iterator {
+		const StreamDescriptor *desc;
+		long pos;
+		long bufStart;
+		struct streamCursor cur;
+		long buf[STREAM_BLOCK];
+
+		void refill();
+
+		public:
+		iterator(const StreamDescriptor *desc, long pos);
+		long operator*() const { return buf[pos - bufStart]; }
+		long position() const { return pos; }
+		iterator &operator++() {
+			if(++pos == bufStart + STREAM_BLOCK && pos < desc->total) {
+				refill();
+			}
+			return *this;
+		}
+		bool operator==(const iterator &other) const { return pos == other.pos; }
+		bool operator!=(const iterator &other) const { return pos != other.pos; }
+	};
+
+	iterator begin() const { return iterator(this, 0); }
+	iterator end() const { return iterator(this, total); }
+	iterator at(long i) const { return iterator(this, i); }
+};
+
+#endif
@@ -0,0 +1,174 @@
+#include "llvm/Support/raw_ostream.h"
+#include "StreamFile.h"
+#include "StreamLog.h"
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool streamWriter::open(const char *path, const char *name, long unit) {
+	fp = fopen(path, "wb");
+	if(!fp) {
+		streamLog() << "Cannot open " << path << " for writing\n";
+		return false;
+	}
+	//the padding after nameLen is written too
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, STREAM_FILE_MAGIC, 4);
+	hdr.version = STREAM_FILE_VERSION;
+	hdr.count = 0;
+	hdr.first = 0;
+	hdr.last = 0;
+	hdr.minAddr = INT64_MAX;
+	hdr.maxAddr = INT64_MIN;
+	hdr.unit = unit;
+	hdr.nameLen = strlen(name);
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+	fwrite(name, 1, hdr.nameLen, fp);
+	buf.resize(STREAM_FILE_BUFFER);
+	used = 0;
+	prev = 0;
+	return true;
+}
+
+void streamWriter::flush() {
+	fwrite(buf.data(), 1, used, fp);
+	used = 0;
+}
+
+void streamWriter::consume(const long *addrs, long n) {
+	if(n > 0 && hdr.count == 0) {
+		hdr.first = addrs[0];
+	}
+	for(long k = 0; k < n; k++) {
+		//a 64 bit varint takes at most 10 bytes
+		if(used + 10 > buf.size()) {
+			flush();
+		}
+		int64_t delta = (int64_t)addrs[k] - prev;
+		uint64_t zz = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+		while(zz >= 0x80) {
+			buf[used++] = (unsigned char)(zz | 0x80);
+			zz >>= 7;
+		}
+		buf[used++] = (unsigned char)zz;
+		prev = addrs[k];
+		if(addrs[k] < hdr.minAddr) {
+			hdr.minAddr = addrs[k];
+		}
+		if(addrs[k] > hdr.maxAddr) {
+			hdr.maxAddr = addrs[k];
+		}
+	}
+	hdr.count += n;
+	if(n > 0) {
+		hdr.last = addrs[n - 1];
+	}
+}
+
+void streamWriter::close() {
+	if(!fp) {
+		return;
+	}
+	flush();
+	fseek(fp, 0, SEEK_SET);
+	fwrite(&hdr, sizeof(hdr), 1, fp);
+	fclose(fp);
+	fp = NULL;
+}
+
+bool writeStream(const StreamDescriptor &desc, const char *path, const char *name) {
+	streamWriter writer;
+	if(!writer.open(path, name, desc.unit())) {
+		return false;
+	}
+	struct streamCursor cur = desc.cursorAt(0);
+	vector<long> chunk(PIPE_CHUNK);
+	for(long pos = 0; pos < desc.size(); pos += PIPE_CHUNK) {
+		long n = desc.size() - pos < PIPE_CHUNK ? desc.size() - pos : PIPE_CHUNK;
+		n = desc.fillCollapsed(cur, chunk.data(), n);
+		writer.consume(chunk.data(), n);
+	}
+	writer.close();
+	return true;
+}
+
+streamReader::~streamReader() {
+	if(base) {
+		munmap((void *)base, len);
+	}
+}
+
+bool streamReader::open(const char *path) {
+	int fd = ::open(path, O_RDONLY);
+	if(fd < 0) {
+		errs() << "Cannot open " << path << "\n";
+		return false;
+	}
+	struct stat st;
+	if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(hdr)) {
+		errs() << path << " is not a stream file\n";
+		::close(fd);
+		return false;
+	}
+	len = st.st_size;
+	void *mem = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(mem == MAP_FAILED) {
+		errs() << "Cannot map " << path << "\n";
+		return false;
+	}
+	base = (const unsigned char *)mem;
+	madvise(mem, len, MADV_SEQUENTIAL);
+
+	memcpy(&hdr, base, sizeof(hdr));
+	if(memcmp(hdr.magic, STREAM_FILE_MAGIC, 4) != 0 || sizeof(hdr) + hdr.nameLen > len) {
+		errs() << path << " is not a stream file\n";
+		return false;
+	}
+	if(hdr.version != STREAM_FILE_VERSION) {
+		errs() << path << " has stream file version " << hdr.version << ", expected " << STREAM_FILE_VERSION << "\n";
+		return false;
+	}
+	name.assign((const char *)base + sizeof(hdr), hdr.nameLen);
+	data = base + sizeof(hdr) + hdr.nameLen;
+	rewind();
+	return true;
+}
+
+void streamReader::rewind() {
+	cur = data;
+	prev = 0;
+	done = 0;
+}
+
+long streamReader::read(long *out, long n) {
+	const unsigned char *end = base + len;
+	long k = 0;
+	for(; k < n && done < (long)hdr.count && cur < end; k++, done++) {
+		uint64_t zz = 0;
+		unsigned shift = 0;
+		while(cur < end && (*cur & 0x80)) {
+			zz |= (uint64_t)(*cur++ & 0x7f) << shift;
+			shift += 7;
+		}
+		if(cur < end) {
+			zz |= (uint64_t)(*cur++) << shift;
+		}
+		int64_t delta = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+		prev = prev + delta;
+		out[k] = prev;
+	}
+	return k;
+}
+
+void streamReader::feed(vector<struct streamConsumer*> &consumers) {
+	vector<long> chunk(PIPE_CHUNK);
+	long n;
+	while((n = read(chunk.data(), PIPE_CHUNK)) > 0) {
+		for(struct streamConsumer *consumer : consumers) {
+			consumer->consume(chunk.data(), n);
+		}
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef _STREAMFILE_H_
+#define _STREAMFILE_H_
+
+#include "StreamStats.h"
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Binary .stream file: a fixed header followed by the name of the stream and
+// the addresses, each stored as the zigzag varint of its difference to the
+// previous one. Strides are small, so most addresses take a single byte.
+#define STREAM_FILE_MAGIC "STRM"
+#define STREAM_FILE_VERSION 3
+#define STREAM_FILE_BUFFER (1 << 20)
+
+struct streamFileHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t count;
+	int64_t first;
+	int64_t last;
+	int64_t minAddr;
+	int64_t maxAddr;
+	int64_t unit;
+	uint32_t nameLen;
+};
+
+// Writes a stream chunk by chunk through a large buffer; the header is
+// patched with the count and address range on close
+class streamWriter : public streamConsumer {
+	FILE *fp;
+	struct streamFileHeader hdr;
+	vector<unsigned char> buf;
+	size_t used;
+	long prev;
+
+	void flush();
+
+	public:
+	streamWriter() : fp(NULL), used(0), prev(0) {}
+	~streamWriter() { close(); }
+	bool open(const char *path, const char *name, long unit = 1);
+	void consume(const long *addrs, long n) override;
+	void close();
+};
+
+bool writeStream(const StreamDescriptor &desc, const char *path, const char *name);
+
+// Memory-mapped reader decoding a .stream file sequentially
+class streamReader {
+	const unsigned char *base;
+	size_t len;
+	const unsigned char *data;
+	const unsigned char *cur;
+	struct streamFileHeader hdr;
+	string name;
+	long prev;
+	long done;
+
+	public:
+	streamReader() : base(NULL), len(0), data(NULL), cur(NULL), prev(0), done(0) {}
+	~streamReader();
+	bool open(const char *path);
+	long size() const { return hdr.count; }
+	const string &getName() const { return name; }
+	long first() const { return hdr.first; }
+	long last() const { return hdr.last; }
+	long unit() const { return hdr.unit; }
+	void rewind();
+	// decodes up to n addresses and returns how many were read
+	long read(long *out, long n);
+	// decodes the remaining stream in PIPE_CHUNK blocks into every consumer
+	void feed(vector<struct streamConsumer*> &consumers);
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef _STREAMLOG_H_
+#define _STREAMLOG_H_
+
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+using namespace llvm;
+
+// Where the stream analyses of the calling thread print their report,
+// errs() unless a streamLogTo is alive on the thread
+inline raw_ostream *&streamLogSink() {
+	static thread_local raw_ostream *sink = nullptr;
+	return sink;
+}
+
+inline raw_ostream &streamLog() {
+	raw_ostream *sink = streamLogSink();
+	return sink ? *sink : errs();
+}
+
+// Collects what the thread prints through streamLog() into text while in
+// scope. Pool tasks nest on one thread, so the previous sink is restored.
+class streamLogTo {
+	raw_ostream *saved;
+	raw_string_ostream out;
+
+	public:
+	streamLogTo(std::string &text) : saved(streamLogSink()), out(text) {
+		streamLogSink() = &out;
+	}
+	~streamLogTo() {
+		out.flush();
+		streamLogSink() = saved;
+	}
+	// hands over what was printed so far and starts over
+	std::string take() {
+		out.flush();
+		std::string text = std::move(out.str());
+		out.str().clear();
+		return text;
+	}
+};
+
+#endif
@@ -0,0 +1,120 @@
+#include "llvm/Support/CommandLine.h"
+#include "StreamPool.h"
+using namespace llvm;
+
+static cl::opt<unsigned> StreamThreads("stream-threads", cl::init(0), cl::desc("Threads used for stream enumeration (0 uses the hardware concurrency)"));
+
+// Index of the pool worker running on this thread, -1 on other threads
+static thread_local int poolWorkerId = -1;
+
+StreamPool::StreamPool(unsigned nthreads) : queued(0), nextQueue(0), stop(false) {
+	for(unsigned i = 0; i < nthreads; i++) {
+		queues.push_back(std::unique_ptr<struct taskQueue>(new taskQueue()));
+	}
+	for(unsigned i = 0; i < nthreads; i++) {
+		workers.push_back(thread(&StreamPool::workerLoop, this, i));
+	}
+}
+
+StreamPool::~StreamPool() {
+	{
+		lock_guard<mutex> guard(sleepLock);
+		stop = true;
+	}
+	wake.notify_all();
+	for(thread &t : workers) {
+		t.join();
+	}
+}
+
+StreamPool &StreamPool::get() {
+	unsigned nthreads = StreamThreads;
+	if(nthreads == 0) {
+		nthreads = thread::hardware_concurrency();
+	}
+	static StreamPool pool(nthreads > 0 ? nthreads : 1);
+	return pool;
+}
+
+void StreamPool::push(function<void()> task) {
+	unsigned q = poolWorkerId >= 0 ? poolWorkerId : nextQueue++ % queues.size();
+	{
+		lock_guard<mutex> guard(queues[q]->lock);
+		queues[q]->tasks.push_back(std::move(task));
+	}
+	queued++;
+	// taking the lock orders the push against a worker about to sleep
+	{
+		lock_guard<mutex> guard(sleepLock);
+	}
+	wake.notify_one();
+}
+
+bool StreamPool::runOne(unsigned home) {
+	function<void()> task;
+	for(unsigned i = 0; i < queues.size() && !task; i++) {
+		struct taskQueue &q = *queues[(home + i) % queues.size()];
+		lock_guard<mutex> guard(q.lock);
+		if(q.tasks.empty()) {
+			continue;
+		}
+		if(i == 0 && poolWorkerId >= 0) {
+			task = std::move(q.tasks.back());
+			q.tasks.pop_back();
+		}
+		else {
+			task = std::move(q.tasks.front());
+			q.tasks.pop_front();
+		}
+	}
+	if(!task) {
+		return false;
+	}
+	queued--;
+	task();
+	return true;
+}
+
+void StreamPool::workerLoop(unsigned id) {
+	poolWorkerId = id;
+	while(true) {
+		if(runOne(id)) {
+			continue;
+		}
+		unique_lock<mutex> lk(sleepLock);
+		wake.wait(lk, [this] { return stop || queued > 0; });
+		if(stop) {
+			return;
+		}
+	}
+}
+
+void StreamPool::parallelFor(long n, long grain, function<void(long, long)> body) {
+	if(grain < 1) {
+		grain = 1;
+	}
+	long nchunks = (n + grain - 1) / grain;
+	if(nchunks <= 1) {
+		if(n > 0) {
+			body(0, n);
+		}
+		return;
+	}
+
+	atomic<long> remaining(nchunks);
+	for(long c = 0; c < nchunks; c++) {
+		long begin = c * grain;
+		long end = begin + grain < n ? begin + grain : n;
+		push([&body, &remaining, begin, end] {
+			body(begin, end);
+			remaining--;
+		});
+	}
+
+	unsigned home = poolWorkerId >= 0 ? poolWorkerId : 0;
+	while(remaining > 0) {
+		if(!runOne(home)) {
+			this_thread::yield();
+		}
+	}
+}
@@ -0,0 +1,49 @@
+#ifndef _STREAMPOOL_H_
+#define _STREAMPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Process-wide work-stealing pool shared by all stream enumeration. It is
+// created on first use, sized from -stream-threads or the hardware
+// concurrency, and lives across runOnFunction calls. Every worker owns a
+// deque it pops from the back; idle workers steal from the front of the
+// others. A thread waiting on its own tasks runs queued work meanwhile, so
+// parallelFor may be nested.
+class StreamPool {
+	struct taskQueue {
+		mutex lock;
+		deque<function<void()>> tasks;
+	};
+
+	vector<unique_ptr<struct taskQueue>> queues;
+	vector<thread> workers;
+	atomic<long> queued;
+	atomic<unsigned> nextQueue;
+	mutex sleepLock;
+	condition_variable wake;
+	bool stop;
+
+	StreamPool(unsigned nthreads);
+	void workerLoop(unsigned id);
+	void push(function<void()> task);
+	bool runOne(unsigned home);
+
+	public:
+	~StreamPool();
+	static StreamPool &get();
+	unsigned size() const { return workers.size(); }
+
+	// Runs body(begin, end) over [0, n) split into chunks of grain elements
+	// and returns once all of them are done
+	void parallelFor(long n, long grain, function<void(long, long)> body);
+};
+
+#endif
@@ -0,0 +1,325 @@
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/Format.h"
+#include "StreamSample.h"
+#include "StreamLog.h"
+#include "StreamPool.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <random>
+
+vector<struct sampleWindow> pickWindows(long total, long budget, unsigned count, bool stratified, unsigned seed) {
+	if(count == 0) {
+		count = 1;
+	}
+	long len = budget / count;
+	if(len < 2) {
+		len = 2;
+	}
+	if(len > total) {
+		len = total;
+	}
+
+	std::mt19937_64 gen(seed);
+	vector<struct sampleWindow> windows;
+	long stratum = stratified ? total / count : total;
+	for(unsigned w = 0; w < count; w++) {
+		long lo = stratified ? w * stratum : 0;
+		long hi = (stratified && w + 1 < count ? lo + stratum : total) - len;
+		if(hi > total - len) {
+			hi = total - len;
+		}
+		if(hi < lo) {
+			lo = hi;
+		}
+		std::uniform_int_distribution<long> pick(lo, hi);
+		struct sampleWindow win;
+		win.start = pick(gen);
+		win.len = len;
+		windows.push_back(win);
+	}
+	std::sort(windows.begin(), windows.end(), [](const struct sampleWindow &a, const struct sampleWindow &b) {
+		return a.start < b.start;
+	});
+	return windows;
+}
+
+// Estimate and 95% confidence half-width of the stream-wide count of every
+// bucket, from the bucket's count in each window of len positions. A run of
+// r addresses is only seen when it lies inside a window, which happens for
+// len - r of the total start positions, so runs are scaled by that instead.
+static void estimate(vector<std::map<long, long>> &perWindow, long total, long len, bool runs, std::map<long, std::pair<double, double>> &out) {
+	std::map<long, bool> keys;
+	for(std::map<long, long> &hist : perWindow) {
+		for(auto &tup : hist) {
+			keys[tup.first] = true;
+		}
+	}
+	double nwin = perWindow.size();
+	for(auto &key : keys) {
+		double sum = 0.0, sumSq = 0.0;
+		for(std::map<long, long> &hist : perWindow) {
+			auto found = hist.find(key.first);
+			double x = found == hist.end() ? 0.0 : found->second;
+			sum += x;
+			sumSq += x * x;
+		}
+		double mean = sum / nwin;
+		double var = nwin > 1 ? (sumSq - nwin * mean * mean) / (nwin - 1) : 0.0;
+		if(var < 0.0) {
+			var = 0.0;
+		}
+		long seen = runs && key.first < len ? len - key.first : len;
+		double tiles = (double)total / seen;
+		double fpc = nwin < tiles ? sqrt(1.0 - nwin / tiles) : 0.0;
+		out[key.first] = std::make_pair(mean * tiles, 1.96 * tiles * sqrt(var / nwin) * fpc);
+	}
+}
+
+static long sampledSize(vector<struct sampleWindow> &windows) {
+	long sampled = 0;
+	for(struct sampleWindow &win : windows) {
+		sampled += win.len;
+	}
+	return sampled;
+}
+
+long sampleStride(const StreamDescriptor &desc, const char *name, vector<struct sampleWindow> &windows) {
+	vector<struct strideChunk> chunks(windows.size());
+	StreamPool::get().parallelFor(windows.size(), 1, [&desc, &windows, &chunks](long begin, long end) {
+		for(long w = begin; w < end; w++) {
+			strideScan(desc, windows[w].start, windows[w].start + windows[w].len, chunks[w]);
+		}
+	});
+
+	vector<std::map<long, long>> runV(windows.size()), jumpV(windows.size());
+	unsigned unbroken = 0;
+	//longest run cut by the edges of a window that jumped, a lower bound when no run fits
+	long partial = 0;
+	for(unsigned w = 0; w < chunks.size(); w++) {
+		for(auto &tup : chunks[w].runs.sorted()) {
+			runV[w][tup.first] = tup.second;
+		}
+		for(auto &tup : chunks[w].jumps.sorted()) {
+			jumpV[w][tup.first] = tup.second;
+		}
+		if(!chunks[w].jumped) {
+			unbroken++;
+		}
+		else {
+			partial = std::max(partial, std::max(chunks[w].lead, chunks[w].trail) + 1);
+		}
+	}
+
+	long len = windows.empty() ? 0 : windows[0].len;
+	std::map<long, std::pair<double, double>> runEst, jumpEst;
+	estimate(runV, desc.size(), len, true, runEst);
+	estimate(jumpV, desc.size(), len, false, jumpEst);
+
+	streamLog() << "Stride analysis based on sampling " << sampledSize(windows) << " of " << desc.size() << " positions of " << name << " in " << windows.size() << " windows:\n";
+	long minRet = INT_MAX;
+	for(auto &tup : runEst) {
+		streamLog() << tup.first << " size continuous substream occurs " << format("%.0f", tup.second.first) << " (+-" << format("%.0f", tup.second.second) << ") times \n";
+		if(minRet > tup.first) {
+			minRet = tup.first;
+		}
+	}
+	if(unbroken > 0) {
+		streamLog() << unbroken << " windows have no jump, their continuous substreams exceed " << len << "\n";
+		if(minRet > len) {
+			minRet = len;
+		}
+	}
+	if(minRet == INT_MAX && partial > 0) {
+		streamLog() << "No window holds a whole continuous substream, they are at least " << partial << "\n";
+		minRet = partial;
+	}
+
+	streamLog() << "Jump analysis: ";
+	for(auto &tup : jumpEst) {
+		streamLog() << tup.first << " : " << format("%.0f", tup.second.first) << " (+-" << format("%.0f", tup.second.second) << ")\t";
+	}
+	streamLog() << "Done\n";
+
+	return minRet;
+}
+
+void sampleReuse(const StreamDescriptor &desc, const char *name, vector<struct sampleWindow> &windows) {
+	vector<std::map<long, long>> histV(windows.size());
+	StreamPool::get().parallelFor(windows.size(), 1, [&desc, &windows, &histV](long begin, long end) {
+		vector<long> chunk(PIPE_CHUNK);
+		for(long w = begin; w < end; w++) {
+			reuseState reuse;
+			struct streamCursor cur = desc.cursorAt(windows[w].start);
+			for(long done = 0; done < windows[w].len; done += PIPE_CHUNK) {
+				long n = windows[w].len - done < PIPE_CHUNK ? windows[w].len - done : PIPE_CHUNK;
+				n = desc.fillCollapsed(cur, chunk.data(), n);
+				reuse.consume(chunk.data(), n);
+			}
+			for(auto &tup : reuse.histogram().sorted()) {
+				histV[w][tup.first] = tup.second;
+			}
+		}
+	});
+
+	//weighted average over all windows, with its spread estimated from the per-window averages
+	double total = 0.0, weight = 0.0;
+	vector<double> avgV;
+	for(std::map<long, long> &hist : histV) {
+		double cnt = 0.0, wt = 0.0;
+		for(auto &tup : hist) {
+			cnt += tup.second;
+			wt += (double)tup.first * tup.second;
+		}
+		total += cnt;
+		weight += wt;
+		if(cnt > 0.0) {
+			avgV.push_back(wt / cnt);
+		}
+	}
+
+	streamLog() << "Reuse analysis of " << name << " sampled in " << windows.size() << " windows : ";
+	if(total == 0.0) {
+		streamLog() << " No reuse in the sampled windows\n";
+		return;
+	}
+	double mean = weight / total;
+	double half = 0.0;
+	if(avgV.size() > 1) {
+		double var = 0.0;
+		for(double avg : avgV) {
+			var += (avg - mean) * (avg - mean);
+		}
+		var = var / (avgV.size() - 1);
+		half = 1.96 * sqrt(var / avgV.size());
+	}
+	double tiles = (double)desc.size() / windows[0].len;
+	streamLog() << (long)mean << " (+-" << (long)half << ") is the weighted reuse distance average over an estimated " << format("%.0f", total / windows.size() * tiles) << " reuses\n";
+}
+
+// splitmix64 finalizer, so nearby addresses get unrelated hashes
+static unsigned long hashAddr(long addr) {
+	unsigned long h = (unsigned long)addr + 0x9E3779B97F4A7C15UL;
+	h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9UL;
+	h = (h ^ (h >> 27)) * 0x94D049BB133111EBUL;
+	return h ^ (h >> 31);
+}
+
+shardsState::shardsState(double rate, unsigned maxTracked) : maxTracked(maxTracked), cold(0.0), sampled(0), accesses(0), finished(false) {
+	threshold = rate >= 1.0 ? 1UL << SHARDS_BITS : (unsigned long)(rate * (1UL << SHARDS_BITS));
+	if(threshold == 0) {
+		threshold = 1;
+	}
+	for(unsigned g = 0; g < SHARDS_GROUPS; g++) {
+		groupCnt[g] = 0.0;
+		groupWt[g] = 0.0;
+	}
+}
+
+void shardsState::flush() {
+	double scale = 1.0 / rate();
+	epoch.forEach([this, scale](long dist, long &cnt) {
+		scaled[(long)(dist * scale)] += cnt * scale;
+	});
+	epoch = flatHist();
+}
+
+void shardsState::consume(const long *addrs, long n) {
+	accesses += n;
+	unsigned long mask = (1UL << SHARDS_BITS) - 1;
+	for(long k = 0; k < n; k++) {
+		unsigned long h = hashAddr(addrs[k]);
+		if((h & mask) >= threshold) {
+			continue;
+		}
+		sampled++;
+		double scale = 1.0 / rate();
+		long dist = reuse.touch(addrs[k]);
+		if(dist >= 0) {
+			epoch.add(dist);
+			unsigned g = h >> (64 - 4);
+			groupCnt[g] += scale;
+			groupWt[g] += dist * scale * scale;
+			continue;
+		}
+		cold += scale;
+		if(maxTracked == 0) {
+			continue;
+		}
+		tracked.push(make_pair(h & mask, addrs[k]));
+		if(tracked.size() <= maxTracked) {
+			continue;
+		}
+		//lower the rate just below the largest tracked hash and drop what is above
+		flush();
+		threshold = tracked.top().first;
+		while(!tracked.empty() && tracked.top().first >= threshold) {
+			reuse.forget(tracked.top().second);
+			tracked.pop();
+		}
+		if(threshold == 0) {
+			threshold = 1;
+		}
+	}
+}
+
+void shardsState::finish() {
+	if(finished) {
+		return;
+	}
+	finished = true;
+	flush();
+	//at a fixed rate, correct the smallest distance by how far the sample
+	//is from the expected accesses (SHARDS_adj)
+	if(maxTracked == 0 && !scaled.empty()) {
+		double diff = (accesses * rate() - sampled) / rate();
+		double &first = scaled.begin()->second;
+		first = first + diff > 0.0 ? first + diff : 0.0;
+	}
+}
+
+void shardsState::histogram(flatHist &hist, long &distinct) {
+	finish();
+	hist = flatHist();
+	for(auto &tup : scaled) {
+		long cnt = (long)(tup.second + 0.5);
+		if(cnt > 0) {
+			hist.add(tup.first, cnt);
+		}
+	}
+	distinct = (long)(cold + 0.5);
+}
+
+void shardsState::report(const char *name) {
+	finish();
+	std::map<long, long> distReuseMap;
+	for(auto &tup : scaled) {
+		long cnt = (long)(tup.second + 0.5);
+		if(cnt > 0) {
+			distReuseMap[tup.first] = cnt;
+		}
+	}
+	printReuse(name, distReuseMap);
+
+	//the groups are independent samples at a sixteenth of the rate
+	double total = 0.0, weight = 0.0;
+	vector<double> avgV;
+	for(unsigned g = 0; g < SHARDS_GROUPS; g++) {
+		total += groupCnt[g];
+		weight += groupWt[g];
+		if(groupCnt[g] > 0.0) {
+			avgV.push_back(groupWt[g] / groupCnt[g]);
+		}
+	}
+	double half = 0.0;
+	if(total > 0.0 && avgV.size() > 1) {
+		double mean = weight / total;
+		double var = 0.0;
+		for(double avg : avgV) {
+			var += (avg - mean) * (avg - mean);
+		}
+		var = var / (avgV.size() - 1);
+		half = 1.96 * sqrt(var / avgV.size());
+	}
+	streamLog() << "Reuse of " << name << " estimated from " << sampled << " of " << accesses << " accesses sampled at rate " << format("%.6f", rate()) << " : average within +-" << (long)half << "\n";
+}
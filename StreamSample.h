@@ -0,0 +1,75 @@
+#ifndef _STREAMSAMPLE_H_
+#define _STREAMSAMPLE_H_
+
+#include "StreamStats.h"
+#include <map>
+#include <queue>
+#include <vector>
+using namespace std;
+
+// Positions [start, start + len) of a stream analyzed in sampling mode
+struct sampleWindow {
+	long start;
+	long len;
+};
+
+// Picks count windows covering budget positions in total. Random windows
+// start anywhere in the stream; stratified ones split the stream into count
+// equal strata, so every part of the outer loops is covered, and start at a
+// random offset inside their stratum. The seed keeps runs reproducible.
+vector<struct sampleWindow> pickWindows(long total, long budget, unsigned count, bool stratified, unsigned seed);
+
+// Stride analysis on the windows only. Every histogram bucket is estimated
+// from its per-window counts, scaled by the number of windows tiling the
+// stream, and printed with a 95% confidence interval. Runs cut by a window
+// edge are dropped and the complete ones scaled for the chance of fitting in
+// a window. Returns the smallest run seen, like strideState.
+long sampleStride(const StreamDescriptor &desc, const char *name, vector<struct sampleWindow> &windows);
+
+// Reuse distance analysis on the windows only; reuses spanning two windows
+// are not observed, so long distances are underestimated
+void sampleReuse(const StreamDescriptor &desc, const char *name, vector<struct sampleWindow> &windows);
+
+// Hash bits compared against the sampling threshold
+#define SHARDS_BITS 24
+// Address groups the spread of the estimate is measured over
+#define SHARDS_GROUPS 16
+
+// Reuse distances estimated from a spatial sample of the addresses
+// (SHARDS). An address is tracked when its hash is under a threshold, so
+// either all accesses to it are seen or none. Distances between tracked
+// addresses are scaled by the inverse of the sampling rate, as are their
+// counts. With a limit on tracked addresses, the rate is lowered whenever
+// more are tracked, dropping those with the largest hash. Memory is then
+// bounded by the limit instead of the distinct addresses of the stream.
+class shardsState : public streamConsumer {
+	reuseState reuse;
+	unsigned long threshold;
+	unsigned maxTracked;
+	std::priority_queue<pair<unsigned long, long>> tracked;
+	//sampled distances at the current rate, scaled when the rate changes
+	flatHist epoch;
+	std::map<long, double> scaled;
+	double cold;
+	long sampled;
+	long accesses;
+	bool finished;
+	double groupCnt[SHARDS_GROUPS];
+	double groupWt[SHARDS_GROUPS];
+
+	void flush();
+	void finish();
+
+	public:
+	// rate is the starting rate; maxTracked 0 keeps it fixed
+	shardsState(double rate, unsigned maxTracked);
+	void consume(const long *addrs, long n) override;
+	double rate() const { return (double)threshold / (1UL << SHARDS_BITS); }
+	// prints the estimate like reuseState::report, then its 95% confidence
+	// interval from the spread between address groups
+	void report(const char *name);
+	// estimated reuse histogram and cold accesses, rounded
+	void histogram(flatHist &hist, long &distinct);
+};
+
+#endif
@@ -0,0 +1,412 @@
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
+#include "StreamStats.h"
+#include "StreamLog.h"
+#include "StreamPool.h"
+#include <algorithm>
+#include <climits>
+
+static cl::opt<unsigned> StreamJumpPositions("stream-jump-positions", cl::init(0), cl::desc("Record the jump index of the first N jumps of every stride difference"));
+
+// Scans addrs following prevpos with the run kernel, calling onJump(diff) at
+// every jump while conCt still holds the run of units before it
+template<typename F>
+static void scanRuns(runKernelFn kernel, const long *addrs, long n, long unit, long &prevpos, long &conCt, F onJump) {
+	long k = 0;
+	while(k < n) {
+		long diff = addrs[k] - prevpos;
+		if(diff == unit) {
+			conCt++;
+		}
+		else if(diff != 0) {
+			onJump(diff);
+			conCt = 0;
+		}
+		long j = kernel(addrs + k, n - k, unit, &conCt);
+		prevpos = addrs[k + j - 1];
+		k += j;
+	}
+}
+
+void strideScan(const StreamDescriptor &desc, long begin, long end, struct strideChunk &chunk) {
+	long start = begin > 0 ? begin - 1 : 0;
+	struct streamCursor cur = desc.cursorAt(start);
+	runKernelFn kernel = getRunKernel();
+	long buf[STREAM_BLOCK];
+	long prevpos = 0;
+	long conCt = 0;
+	long unit = desc.unit();
+	unsigned cap = StreamJumpPositions;
+	chunk.jumped = false;
+	chunk.lead = 0;
+	chunk.njumps = 0;
+	auto onJump = [&chunk, &conCt, cap](long diff) {
+		if(!chunk.jumped) {
+			chunk.lead = conCt;
+			chunk.jumped = true;
+		}
+		else {
+			chunk.runs.add(conCt + 1);
+		}
+		if(cap > 0 && chunk.jumps.get(diff) < cap) {
+			chunk.jumpPos.push_back(std::make_pair(diff, chunk.njumps));
+		}
+		chunk.jumps.add(diff);
+		chunk.njumps++;
+	};
+	for(long pos = start; pos < end; pos += STREAM_BLOCK) {
+		long n = end - pos < STREAM_BLOCK ? end - pos : STREAM_BLOCK;
+		desc.fill(cur, buf, n);
+		long k = 0;
+		if(pos == start) {
+			prevpos = buf[0];
+			k = 1;
+		}
+		scanRuns(kernel, buf + k, n - k, unit, prevpos, conCt, onJump);
+	}
+	chunk.trail = conCt;
+}
+
+void strideState::jump(long diff) {
+	conCt++;
+	runs.add(conCt);
+	if(StreamJumpPositions > 0 && jumpPos[diff].size() < StreamJumpPositions) {
+		jumpPos[diff].push_back(strideIn);
+	}
+	jumps.add(diff);
+	strideIn++;
+}
+
+void strideState::consume(const long *addrs, long n) {
+	long k = 0;
+	if(!started && n > 0) {
+		prevpos = addrs[0];
+		started = true;
+		k = 1;
+	}
+	scanRuns(getRunKernel(), addrs + k, n - k, unit, prevpos, conCt, [this](long diff) {
+		jump(diff);
+	});
+}
+
+void strideState::absorb(struct strideChunk &chunk) {
+	if(!chunk.jumped) {
+		conCt += chunk.trail;
+		return;
+	}
+	runs.add(conCt + chunk.lead + 1);
+	runs.merge(chunk.runs);
+	for(auto &tup : chunk.jumpPos) {
+		if(jumpPos[tup.first].size() < StreamJumpPositions) {
+			jumpPos[tup.first].push_back(strideIn + tup.second);
+		}
+	}
+	jumps.merge(chunk.jumps);
+	strideIn += chunk.njumps;
+	conCt = chunk.trail;
+}
+
+void strideState::close() {
+	if(conCt != 0) {
+		conCt++;
+		runs.add(conCt);
+		conCt = 0;
+	}
+}
+
+bool strideState::matches(strideState &other) {
+	close();
+	other.close();
+	return runs.sorted() == other.runs.sorted() && jumps.sorted() == other.jumps.sorted();
+}
+
+long strideState::report(const char *name, long size, const char *source) {
+	close();
+
+	streamLog() << "Stride analysis based on " << source << " of " << name << " which has total size "<< size << ":\n";
+	long minRet = INT_MAX;
+	for(auto &tup : runs.sorted()) {
+		streamLog() << tup.first << " size continuous substream occurs " << tup.second << " times \n";
+		if(minRet > tup.first) {
+			minRet = tup.first;
+		}
+	}
+
+	streamLog() << "Jump analysis: ";
+
+	for(auto &tup : jumps.sorted()) {
+		streamLog() << tup.first << " : " << tup.second;
+		auto found = jumpPos.find(tup.first);
+		if(found != jumpPos.end()) {
+			streamLog() << " at";
+			for(long pos : found->second) {
+				streamLog() << " " << pos;
+			}
+		}
+		streamLog() << "\t";
+	}
+
+	streamLog() << "Done\n";
+
+	return minRet;
+}
+
+void reuseState::mark(long slot, long delta) {
+	for(long i = slot + 1; i < (long)tree.size(); i += i & -i) {
+		tree[i] += delta;
+	}
+}
+
+long reuseState::marksUpTo(long slot) const {
+	long sum = 0;
+	for(long i = slot + 1; i > 0; i -= i & -i) {
+		sum += tree[i];
+	}
+	return sum;
+}
+
+void reuseState::compact() {
+	//the last uses keep their order, so the distances do not change
+	vector<pair<long, long>> order;
+	lastUse.forEach([&order](long addr, long &slot) {
+		//0 is an address absorbed into a later partition
+		if(slot != 0) {
+			order.push_back(make_pair(slot, addr));
+		}
+	});
+	std::sort(order.begin(), order.end());
+	long slots = 2 * (long)order.size() > REUSE_MIN_SLOTS ? 2 * (long)order.size() : REUSE_MIN_SLOTS;
+	tree.assign(slots + 1, 0);
+	for(long k = 0; k < (long)order.size(); k++) {
+		lastUse.at(order[k].second) = k + 1;
+	}
+	//linear Fenwick build with the first order.size() slots marked
+	for(long i = 1; i <= slots; i++) {
+		if(i <= (long)order.size()) {
+			tree[i] += 1;
+		}
+		long parent = i + (i & -i);
+		if(parent <= slots) {
+			tree[parent] += tree[i];
+		}
+	}
+	now = order.size();
+}
+
+long reuseState::touch(long addr) {
+	if(now + 1 == (long)tree.size()) {
+		compact();
+	}
+	long dist = -1;
+	//slots are stored plus one so that 0 means no previous use
+	long &prev = lastUse.at(addr);
+	if(prev != 0) {
+		dist = live - marksUpTo(prev - 1);
+		mark(prev - 1, -1);
+	}
+	else {
+		live++;
+		if(tracking) {
+			firsts.push_back(addr);
+		}
+	}
+	mark(now, 1);
+	prev = now + 1;
+	now++;
+	return dist;
+}
+
+void reuseState::forget(long addr) {
+	long prev = lastUse.get(addr);
+	if(prev != 0) {
+		mark(prev - 1, -1);
+		live--;
+		lastUse.erase(addr);
+	}
+}
+
+void reuseState::consume(const long *addrs, long n) {
+	for(long k = 0; k < n; k++) {
+		long dist = touch(addrs[k]);
+		if(dist >= 0) {
+			distReuse.add(dist);
+		}
+	}
+}
+
+void reuseState::absorb(reuseState &part) {
+	if(now == 0 && distReuse.size() == 0) {
+		bool track = tracking;
+		std::swap(*this, part);
+		tracking = track;
+		if(!tracking) {
+			vector<long>().swap(firsts);
+		}
+		return;
+	}
+	distReuse.merge(part.distReuse);
+	for(long c = 0; c < (long)part.firsts.size(); c++) {
+		long &prev = lastUse.at(part.firsts[c]);
+		if(prev != 0) {
+			distReuse.add(c + live - marksUpTo(prev - 1));
+			mark(prev - 1, -1);
+			live--;
+			prev = 0;
+		}
+		else if(tracking) {
+			firsts.push_back(part.firsts[c]);
+		}
+	}
+
+	vector<pair<long, long>> order;
+	part.lastUse.forEach([&order](long addr, long &slot) {
+		order.push_back(make_pair(slot, addr));
+	});
+	std::sort(order.begin(), order.end());
+	for(auto &tup : order) {
+		if(now + 1 == (long)tree.size()) {
+			compact();
+		}
+		lastUse.at(tup.second) = now + 1;
+		mark(now, 1);
+		now++;
+		live++;
+	}
+}
+
+void reuseScan(const StreamDescriptor &desc, reuseState &reuse, long parts) {
+	long total = desc.size();
+	if(parts <= 0) {
+		parts = StreamPool::get().size();
+	}
+	if(parts > total) {
+		parts = total > 0 ? total : 1;
+	}
+	long len = (total + parts - 1) / parts;
+	vector<reuseState> partV(parts > 1 ? parts : 0);
+	StreamPool::get().parallelFor(total, len, [&desc, &reuse, &partV, len](long begin, long end) {
+		reuseState &state = partV.empty() ? reuse : partV[begin / len];
+		if(!partV.empty()) {
+			state.trackFirsts();
+		}
+		struct streamCursor cur = desc.cursorAt(begin);
+		vector<long> chunk(PIPE_CHUNK);
+		if(begin > 0 && desc.lineMode()) {
+			//collapse against the line the previous part ends on
+			cur = desc.cursorAt(begin - 1);
+			desc.fillCollapsed(cur, chunk.data(), 1);
+		}
+		for(long pos = begin; pos < end; pos += PIPE_CHUNK) {
+			long n = end - pos < PIPE_CHUNK ? end - pos : PIPE_CHUNK;
+			n = desc.fillCollapsed(cur, chunk.data(), n);
+			state.consume(chunk.data(), n);
+		}
+	});
+	for(long step = 1; step < (long)partV.size(); step *= 2) {
+		long pairs = (partV.size() + 2 * step - 1) / (2 * step);
+		StreamPool::get().parallelFor(pairs, 1, [&partV, step](long begin, long end) {
+			for(long k = begin; k < end; k++) {
+				long left = 2 * step * k;
+				if(left + step < (long)partV.size()) {
+					partV[left].absorb(partV[left + step]);
+					partV[left + step] = reuseState();
+				}
+			}
+		});
+	}
+	if(!partV.empty()) {
+		reuse.absorb(partV[0]);
+	}
+}
+
+void reuseState::report(const char *name) {
+	std::map<long, long> distReuseMap;
+	for(auto &tup : distReuse.sorted()) {
+		distReuseMap[tup.first] = tup.second;
+	}
+	printReuse(name, distReuseMap);
+}
+
+void printReuse(const char *name, std::map<long, long> &distReuseMap) {
+	streamLog() << "Reuse analysis of " << name << " : ";
+
+	double total = 0.0;
+	double weight = 0;
+	for(auto &tup : distReuseMap) {
+		//streamLog() << tup.first << " reuse distance occurs " << tup.second << " times \n";
+		total += tup.second;
+		weight += (double)tup.first * tup.second;
+	}
+
+	if(total > 0.0) {
+		streamLog() << (long)(weight/total) << " is the weighted reuse distance average\n";
+	}
+	else {
+		streamLog() << " No reuse in the stream\n";
+	}
+}
+
+struct missCurve missCurveOf(const flatHist &hist, long distinct, long accesses, const vector<long> &sizes, long unitBytes) {
+	//reuses at distance d or more, over the distances in increasing order
+	vector<pair<long, long>> dist = hist.sorted();
+	vector<long> atLeast(dist.size() + 1, 0);
+	for(long k = (long)dist.size() - 1; k >= 0; k--) {
+		atLeast[k] = atLeast[k + 1] + dist[k].second;
+	}
+
+	struct missCurve curve;
+	curve.sizes = sizes;
+	curve.accesses = accesses;
+	for(long size : sizes) {
+		long capacity = size / unitBytes;
+		auto first = std::lower_bound(dist.begin(), dist.end(), make_pair(capacity, LONG_MIN));
+		curve.misses.push_back(distinct + atLeast[first - dist.begin()]);
+	}
+	return curve;
+}
+
+void printMissCurve(const char *name, const struct missCurve &curve) {
+	streamLog() << "Miss ratio curve of " << name << " over " << curve.accesses << " accesses :";
+	for(unsigned k = 0; k < curve.sizes.size(); k++) {
+		double ratio = curve.accesses > 0 ? (double)curve.misses[k] / curve.accesses : 0.0;
+		if(curve.sizes[k] % 1024 == 0) {
+			streamLog() << " " << curve.sizes[k] / 1024 << "K " << format("%.4f", ratio);
+		}
+		else {
+			streamLog() << " " << curve.sizes[k] << "B " << format("%.4f", ratio);
+		}
+	}
+	streamLog() << "\n";
+}
+
+void pipeStream(const StreamDescriptor &desc, std::vector<struct streamConsumer*> &consumers) {
+	std::vector<std::vector<long>> slots(PIPE_SLOTS, std::vector<long>(PIPE_CHUNK));
+	std::vector<long> counts(PIPE_SLOTS, 0);
+	struct streamCursor cur = desc.cursorAt(0);
+	auto produce = [&desc, &slots, &counts, &cur](long pos, unsigned slot) {
+		long n = desc.size() - pos < PIPE_CHUNK ? desc.size() - pos : PIPE_CHUNK;
+		counts[slot] = desc.fillCollapsed(cur, slots[slot].data(), n);
+	};
+	if(desc.size() > 0) {
+		produce(0, 0);
+	}
+
+	//chunk k goes to every consumer while chunk k + 1 is generated, one pool task each
+	unsigned nc = consumers.size();
+	for(long pos = 0, k = 0; pos < desc.size(); pos += PIPE_CHUNK, k++) {
+		unsigned slot = k % PIPE_SLOTS;
+		long next = pos + PIPE_CHUNK;
+		long tasks = next < desc.size() ? nc + 1 : nc;
+		StreamPool::get().parallelFor(tasks, 1, [&](long begin, long end) {
+			for(long t = begin; t < end; t++) {
+				if(t < nc) {
+					consumers[t]->consume(slots[slot].data(), counts[slot]);
+				}
+				else {
+					produce(next, (k + 1) % PIPE_SLOTS);
+				}
+			}
+		});
+	}
+}
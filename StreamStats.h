@@ -0,0 +1,141 @@
+#ifndef _STREAMSTATS_H_
+#define _STREAMSTATS_H_
+
+#include "StreamDesc.h"
+#include "FlatHist.h"
+#include <map>
+#include <vector>
+using namespace std;
+
+// Chunks handed to the consumers of a pipelined stream
+#define PIPE_CHUNK (1 << 16)
+#define PIPE_SLOTS 2
+
+// An analysis fed with a stream chunk by chunk; state carries across calls
+struct streamConsumer {
+	virtual ~streamConsumer() {}
+	virtual void consume(const long *addrs, long n) = 0;
+};
+
+// Stride summary of the differences inside one chunk of a stream. Runs and
+// jumps are relative to the chunk; the run before the first jump and after
+// the last one stay open until the chunk is stitched to its neighbours.
+// Jumps are only counted; with -stream-jump-positions the chunk also keeps
+// the index of the first jumps of every difference.
+struct strideChunk {
+	bool jumped;
+	long lead;
+	long trail;
+	flatHist runs;
+	flatHist jumps;
+	long njumps;
+	std::vector<std::pair<long, long>> jumpPos;
+};
+
+// Scans the address differences of positions [begin, end) of a stream
+void strideScan(const StreamDescriptor &desc, long begin, long end, struct strideChunk &chunk);
+
+// Run lengths of unit-stride substreams and the jumps between them; unit is
+// the address difference of contiguous accesses (the element size for byte
+// addresses)
+class strideState : public streamConsumer {
+	bool started;
+	long unit;
+	long prevpos;
+	long conCt;
+	long strideIn;
+	flatHist runs;
+	flatHist jumps;
+	std::map<long, std::vector<long>> jumpPos;
+
+	void jump(long diff);
+	void close();
+
+	public:
+	strideState(long unit = 1) : started(false), unit(unit), prevpos(0), conCt(0), strideIn(0) {}
+	void consume(const long *addrs, long n) override;
+	// appends a chunk scanned by strideScan, closing the run across the boundary
+	void absorb(struct strideChunk &chunk);
+	// closes the last run, prints the histograms and returns the smallest run;
+	// source names where the histograms came from
+	long report(const char *name, long size, const char *source = "enumeration");
+	// same run and jump histograms as other, once both runs are closed
+	bool matches(strideState &other);
+};
+
+// Initial number of access slots of the reuse Fenwick tree
+#define REUSE_MIN_SLOTS (1 << 16)
+
+// Stack distance of every reuse, the number of distinct addresses accessed
+// since the last access to the same address. Every access takes a slot in
+// a Fenwick tree that is marked while it is the last use of its address, so
+// a distance is the count of marks after the previous use, in O(log n).
+// When the slots run out the live marks are renumbered from 0, so memory
+// follows the distinct addresses rather than the stream length.
+class reuseState : public streamConsumer {
+	vector<long> tree;
+	long now;
+	long live;
+	flatHist lastUse;
+	flatHist distReuse;
+	bool tracking;
+	vector<long> firsts;
+
+	void mark(long slot, long delta);
+	long marksUpTo(long slot) const;
+	void compact();
+
+	public:
+	reuseState() : tree(REUSE_MIN_SLOTS + 1, 0), now(0), live(0), tracking(false) {}
+	void consume(const long *addrs, long n) override;
+	// distance of one access without recording it, -1 for the first one
+	long touch(long addr);
+	// drops addr from the stack, for samplers that stop tracking it
+	void forget(long addr);
+	void report(const char *name);
+	const flatHist &histogram() const { return distReuse; }
+	// distinct addresses, each of which had one access without reuse
+	long distinct() const { return live; }
+
+	// For a partition of a stream: also keep the distinct addresses in
+	// first access order, whose distances depend on the partitions before
+	void trackFirsts() { tracking = true; }
+	// Appends the partition that directly follows what was consumed so far.
+	// A first access of part at distinct index c that was used here has
+	// distance c plus the marks after that use not yet taken over by part's
+	// earlier first accesses; then part's last uses become the newest marks
+	// in order. The rest of part's first accesses stay unresolved in firsts.
+	void absorb(reuseState &part);
+};
+
+// Reuse analysis of a whole stream, with the same histogram as consuming it
+// serially. The stream is cut into parts (one per pool thread when 0) that
+// run through their own reuseState on the pool, and neighbouring parts are
+// absorbed pairwise in a tree, so a merge only handles the distinct
+// addresses of the two ranges and the merges of one round run in parallel.
+void reuseScan(const StreamDescriptor &desc, reuseState &reuse, long parts = 0);
+
+void printReuse(const char *name, std::map<long, long> &distReuseMap);
+
+// Misses of a fully associative LRU cache at each of a list of sizes in
+// bytes. An access misses when it is the first one to its address or when
+// at least as many distinct addresses as fit came in between, so the whole
+// curve follows from the reuse histogram.
+struct missCurve {
+	vector<long> sizes;
+	vector<long> misses;
+	long accesses;
+};
+
+// Curve of a stream of accesses with reuse histogram hist and cold misses
+// distinct, for cache sizes in bytes and addresses of unitBytes each
+struct missCurve missCurveOf(const flatHist &hist, long distinct, long accesses, const vector<long> &sizes, long unitBytes);
+void printMissCurve(const char *name, const struct missCurve &curve);
+
+// Generates the stream a chunk at a time and feeds every chunk to all
+// consumers as tasks on the stream pool, generating the next chunk in the
+// same round, so memory stays at O(chunk) whatever the trip counts are and
+// no threads are started per stream
+void pipeStream(const StreamDescriptor &desc, std::vector<struct streamConsumer*> &consumers);
+
+#endif
@@ -0,0 +1,79 @@
+// Offline analyzer for the .stream files written by stat1loop with
+// -stream-dump-dir, so stride, reuse and dependence analysis can be rerun
+// without rerunning opt.
+//
+//   stream-analyze [-reuse] [-deps] file.stream...
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+#include "StreamFile.h"
+#include <climits>
+#include <map>
+using namespace llvm;
+
+static cl::list<std::string> InputFiles(cl::Positional, cl::OneOrMore, cl::desc("<stream files>"));
+static cl::opt<bool> Reuse("reuse", cl::init(false), cl::desc("Run reuse distance analysis"));
+static cl::opt<bool> Deps("deps", cl::init(false), cl::desc("Group the streams of each array and report their address windows"));
+
+struct streamSummary {
+	std::string file;
+	long first;
+	long last;
+	long size;
+};
+
+int main(int argc, char **argv) {
+	cl::ParseCommandLineOptions(argc, argv, "Offline stream analysis\n");
+
+	std::map<std::string, std::vector<struct streamSummary>> byName;
+	for(std::string &file : InputFiles) {
+		streamReader reader;
+		if(!reader.open(file.c_str())) {
+			return 1;
+		}
+
+		strideState stride(reader.unit());
+		reuseState reuse;
+		std::vector<struct streamConsumer*> consumers;
+		consumers.push_back(&stride);
+		if(Reuse) {
+			consumers.push_back(&reuse);
+		}
+		reader.feed(consumers);
+		stride.report(reader.getName().c_str(), reader.size());
+		if(Reuse) {
+			reuse.report(reader.getName().c_str());
+		}
+
+		struct streamSummary sum;
+		sum.file = file;
+		sum.first = reader.first();
+		sum.last = reader.last();
+		sum.size = reader.size();
+		byName[reader.getName()].push_back(sum);
+	}
+
+	if(!Deps) {
+		return 0;
+	}
+	for(auto &group : byName) {
+		std::vector<struct streamSummary> &matchV = group.second;
+		if(matchV.size() <= 1) {
+			continue;
+		}
+		errs() << group.first << " occurs " << matchV.size() << " times ";
+		long start = LONG_MAX, end = LONG_MIN;
+		int count = 1;
+		for(struct streamSummary &sum : matchV) {
+			if(start > sum.first) {
+				start = sum.first;
+			}
+			if(end < sum.last) {
+				end = sum.last;
+			}
+			errs() << " Stream " << count << ":[" << sum.first << "-" << sum.last << "] ";
+			count++;
+		}
+		errs() << "\nCumulative: start=" << start << " end=" << end << " with window size of " << matchV[0].size << "\n";
+	}
+	return 0;
+}
@@ -0,0 +1,271 @@
+#include "StrideModel.h"
+#include <algorithm>
+
+// a = a followed by b
+static void concat(struct strideChunk &a, const struct strideChunk &b) {
+	if(!b.jumped) {
+		a.trail += b.trail;
+		return;
+	}
+	if(!a.jumped) {
+		long units = a.trail;
+		a = b;
+		a.lead += units;
+		return;
+	}
+	a.runs.add(a.trail + b.lead + 1);
+	a.runs.merge(b.runs);
+	a.jumps.merge(b.jumps);
+	a.njumps += b.njumps;
+	a.trail = b.trail;
+}
+
+static void emptyChunk(struct strideChunk &chunk) {
+	chunk.jumped = false;
+	chunk.lead = 0;
+	chunk.trail = 0;
+	chunk.njumps = 0;
+}
+
+// p repeated times times
+static struct strideChunk repeat(const struct strideChunk &p, long times) {
+	struct strideChunk out, sq = p;
+	emptyChunk(out);
+	while(times > 0) {
+		if(times & 1) {
+			concat(out, sq);
+		}
+		times >>= 1;
+		if(times > 0) {
+			struct strideChunk twice = sq;
+			concat(twice, sq);
+			sq = twice;
+		}
+	}
+	return out;
+}
+
+//stride of every loop of the nest per iteration, zero for loops the address does not use
+static bool loopStrides(const StreamDescriptor &desc, vector<long> &strideV) {
+	const struct compiledChains &cc = desc.compiled();
+	if(!desc.rectangular() || desc.lineMode() || !cc.terms.empty() || desc.size() == 0) {
+		return false;
+	}
+	strideV.assign(desc.getBounds().size(), 0);
+	const vector<struct streamLevel> &levels = desc.getLevels();
+	for(unsigned lvl = 0; lvl < levels.size(); lvl++) {
+		strideV[levels[lvl].loop] += cc.slope[lvl] * levels[lvl].stepV;
+	}
+	return true;
+}
+
+bool strideClosedForm(const StreamDescriptor &desc, struct strideChunk &chunk) {
+	vector<long> strideV;
+	if(!loopStrides(desc, strideV)) {
+		return false;
+	}
+
+	//sweep of the loops inside the current one; no loops is a single point
+	emptyChunk(chunk);
+	long span = 0;
+	for(int l = strideV.size() - 1; l >= 0; l--) {
+		long trip = desc.tripOf(l);
+		long diff = strideV[l] - span;
+		struct strideChunk step;
+		emptyChunk(step);
+		if(diff == desc.unit()) {
+			step.trail = 1;
+		}
+		else if(diff != 0) {
+			step.jumped = true;
+			step.jumps.add(diff);
+			step.njumps = 1;
+		}
+		concat(step, chunk);
+		concat(chunk, repeat(step, trip - 1));
+		span += strideV[l] * (trip - 1);
+	}
+	return true;
+}
+
+bool reuseClosedForm(const StreamDescriptor &desc, vector<struct reuseCarried> &carried, long &distinct) {
+	vector<long> strideV;
+	if(!loopStrides(desc, strideV)) {
+		return false;
+	}
+	vector<pair<long, long>> moving;
+	for(unsigned l = 0; l < strideV.size(); l++) {
+		long trip = desc.tripOf(l);
+		if(strideV[l] != 0 && trip > 1) {
+			moving.push_back(make_pair(strideV[l] < 0 ? -strideV[l] : strideV[l], trip));
+		}
+	}
+	std::sort(moving.begin(), moving.end());
+	long span = 0;
+	for(auto &mv : moving) {
+		if(mv.first <= span) {
+			//two counter tuples may meet at one address
+			return false;
+		}
+		span += mv.first * (mv.second - 1);
+	}
+
+	carried.clear();
+	distinct = 1;
+	long outer = 1;
+	for(unsigned l = 0; l < strideV.size(); l++) {
+		long trip = desc.tripOf(l);
+		if(strideV[l] != 0) {
+			distinct *= trip;
+		}
+		else if(trip > 1) {
+			long inner = 1;
+			for(unsigned j = l + 1; j < strideV.size(); j++) {
+				if(strideV[j] != 0) {
+					inner *= desc.tripOf(j);
+				}
+			}
+			struct reuseCarried rc;
+			rc.loop = l;
+			rc.distance = inner - 1;
+			rc.count = outer * (trip - 1) * inner;
+			carried.push_back(rc);
+		}
+		outer *= trip;
+	}
+	return true;
+}
+
+long dmaPattern::size() const {
+	long n = 1;
+	for(auto &dim : dims) {
+		n = n * dim.first;
+	}
+	return n;
+}
+
+bool dmaClosedForm(const StreamDescriptor &desc, struct dmaDesc &dma) {
+	vector<long> strideV;
+	if(!loopStrides(desc, strideV)) {
+		return false;
+	}
+	dma.main.offset = 0;
+	dma.main.start = desc.front();
+	dma.main.dims.clear();
+	dma.remainder.clear();
+	dma.unresolved = 0;
+	for(int l = strideV.size() - 1; l >= 0; l--) {
+		long trip = desc.tripOf(l);
+		if(trip == 1) {
+			continue;
+		}
+		vector<pair<long, long>> &dims = dma.main.dims;
+		if(!dims.empty() && strideV[l] == dims.back().first * dims.back().second) {
+			dims.back().first *= trip;
+		}
+		else {
+			dims.push_back(make_pair(trip, strideV[l]));
+		}
+	}
+	return true;
+}
+
+// Stream positions read sequentially in chunks, from the descriptor or
+// from the collapsed buffer of a line stream
+struct dmaSource {
+	const StreamDescriptor *desc;
+	const long *addrs;
+	long total;
+
+	long at(long pos) const {
+		return addrs ? addrs[pos] : desc->addrAt(pos);
+	}
+	void read(long pos, long *out, long n) const {
+		if(addrs) {
+			std::copy(addrs + pos, addrs + pos + n, out);
+		}
+		else {
+			desc->fill(pos, out, n);
+		}
+	}
+};
+
+// Number of positions from pos on, at most n, that follow pattern p
+// repeated every stride
+static long matchBlocks(const struct dmaSource &src, long pos, long n, const struct dmaPattern &p, long stride) {
+	vector<long> digits(p.dims.size(), 0);
+	long expect = p.start;
+	long blockStart = p.start;
+	vector<long> chunk(PIPE_CHUNK);
+	for(long done = 0; done < n; done += PIPE_CHUNK) {
+		long cnt = n - done < PIPE_CHUNK ? n - done : PIPE_CHUNK;
+		src.read(pos + done, chunk.data(), cnt);
+		for(long k = 0; k < cnt; k++) {
+			if(chunk[k] != expect) {
+				return done + k;
+			}
+			unsigned d = 0;
+			for(; d < digits.size(); d++) {
+				expect += p.dims[d].second;
+				if(++digits[d] < p.dims[d].first) {
+					break;
+				}
+				expect -= p.dims[d].second * p.dims[d].first;
+				digits[d] = 0;
+			}
+			if(d == digits.size()) {
+				blockStart += stride;
+				expect = blockStart;
+			}
+		}
+	}
+	return n;
+}
+
+static struct dmaPattern fitPattern(const struct dmaSource &src, long pos) {
+	struct dmaPattern p;
+	p.offset = pos;
+	p.start = src.at(pos);
+	long avail = src.total - pos;
+	long covered = 1;
+	while(covered < avail) {
+		long stride = src.at(pos + covered) - p.start;
+		long count = matchBlocks(src, pos, avail, p, stride) / covered;
+		if(count <= 1) {
+			break;
+		}
+		p.dims.push_back(make_pair(count, stride));
+		covered = covered * count;
+	}
+	return p;
+}
+
+void dmaFit(const StreamDescriptor &desc, unsigned maxSegments, struct dmaDesc &dma) {
+	struct dmaSource src;
+	src.desc = &desc;
+	src.addrs = NULL;
+	src.total = desc.size();
+	std::unique_ptr<long[]> lines;
+	if(desc.lineMode()) {
+		lines = desc.materialize(src.total);
+		src.addrs = lines.get();
+	}
+
+	dma.main.offset = 0;
+	dma.main.start = 0;
+	dma.main.dims.clear();
+	dma.remainder.clear();
+	dma.unresolved = src.total;
+	long pos = 0;
+	for(unsigned seg = 0; seg <= maxSegments && pos < src.total; seg++) {
+		struct dmaPattern p = fitPattern(src, pos);
+		if(seg == 0) {
+			dma.main = p;
+		}
+		else {
+			dma.remainder.push_back(p);
+		}
+		pos += p.size();
+	}
+	dma.unresolved = src.total - pos;
+}
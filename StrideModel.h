@@ -0,0 +1,69 @@
+#ifndef _STRIDEMODEL_H_
+#define _STRIDEMODEL_H_
+
+#include "StreamStats.h"
+
+// Stride analysis without enumeration for streams whose chains are all
+// affine in a rectangular nest. With per-counter stride s_l and trip count
+// T_l of loop l, the difference when loop l advances and the inner loops
+// wrap is s_l - sum_{j>l} s_j (T_j - 1), so the differences of one sweep of
+// loop l are T_l copies of the inner sweep separated by that difference.
+// The sweeps are folded into a strideChunk summary from the innermost loop
+// out, repeating by doubling, in O(loops * log trip) merges.
+//
+// Fills chunk with the summary of the whole stream, to be absorbed into a
+// strideState, and returns false when the stream has Mod/And/Rshift terms,
+// a non-rectangular nest or line addresses, which need enumeration.
+bool strideClosedForm(const StreamDescriptor &desc, struct strideChunk &chunk);
+
+// Reuses carried by one loop of the nest: count accesses whose address was
+// last used one iteration of the loop earlier, with distance distinct
+// addresses in between
+struct reuseCarried {
+	unsigned loop;
+	long distance;
+	long count;
+};
+
+// Reuse analysis without enumeration, for the streams strideClosedForm
+// handles whose address takes distinct values for distinct counters of the
+// loops with a nonzero stride (checked by every stride exceeding the span of
+// the smaller ones). An address then recurs only across loops with stride
+// 0: its next use is one iteration of the innermost such loop that is not
+// at its last iteration, after a sweep of the loops inside it that touches
+// the product of their nonzero-stride trip counts of addresses. distinct
+// gets the addresses, each with one access without reuse.
+bool reuseClosedForm(const StreamDescriptor &desc, vector<struct reuseCarried> &carried, long &distinct);
+
+// Nested (count, stride) pattern as taken by address generators and DMA
+// engines: start + sum_l i_l * stride_l for i_l < count_l, innermost
+// dimension first. offset is the stream position of its first address.
+struct dmaPattern {
+	long offset;
+	long start;
+	vector<pair<long, long>> dims;
+
+	long size() const;
+};
+
+// A stream as one main pattern plus the remainder it does not cover. The
+// remainder is fitted as further patterns; what is left after the segment
+// limit is only counted in unresolved.
+struct dmaDesc {
+	struct dmaPattern main;
+	vector<struct dmaPattern> remainder;
+	long unresolved;
+};
+
+// Exact descriptor of an affine stream in a rectangular nest from the loop
+// strides and trip counts, with a loop merged into the one inside it when
+// it continues it; false where strideClosedForm does not apply.
+bool dmaClosedForm(const StreamDescriptor &desc, struct dmaDesc &dma);
+
+// Fits patterns to the addresses greedily: the first dimension is the
+// longest arithmetic prefix, and each next one the longest repetition of
+// everything fitted so far at a constant stride. Reads the stream
+// sequentially once per dimension; line streams are collapsed first.
+void dmaFit(const StreamDescriptor &desc, unsigned maxSegments, struct dmaDesc &dma);
+
+#endif